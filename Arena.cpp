@@ -0,0 +1,52 @@
+#include "Arena.h"
+
+const size_t Arena::BLOCK_BYTES;
+
+Arena::Arena(size_t blockBytes)
+  : blockBytes(max(blockBytes, (size_t)64)), current(0), offset(0), used(0), peak(0),
+    reserved(0)
+{
+}
+
+void* Arena::allocate(size_t bytes, size_t alignment)
+{
+  while (current < blocks.size())
+  {
+    Block& b = blocks[current];
+    uintptr_t base = (uintptr_t)b.memory.get();
+    size_t start = (size_t)(((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+    if (start <= b.size && b.size - start >= bytes)
+    {
+      offset = start + bytes;
+      used += bytes;
+      peak = max(peak, used);
+      return b.memory.get() + start;
+    }
+    current++;
+    offset = 0;
+  }
+
+  // Out of blocks: add one, big enough for this if it is a big one
+  Block b;
+  b.size = max(blockBytes, bytes + alignment);
+  b.memory.reset(new char[b.size]);
+  reserved += b.size;
+  blocks.push_back(move(b));
+  current = blocks.size() - 1;
+  offset = 0;
+  return allocate(bytes, alignment);
+}
+
+void Arena::reset()
+{
+  current = 0;
+  offset = 0;
+  used = 0;
+}
+
+void Arena::rewind(const Mark& m)
+{
+  current = m.block;
+  offset = m.offset;
+  used = m.used;
+}
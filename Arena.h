@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+/*
+ * Arena is a bump allocator for scratch memory: allocate() carves
+ * pieces out of large blocks, and reset() takes all of them back at
+ * once, keeping the blocks for next time. Work that builds and drops
+ * many small objects, search after search, then neither calls malloc
+ * for each nor fragments the heap. Nothing in an Arena is destroyed,
+ * so it only holds trivially destructible types.
+ *
+ * mark() and rewind() take back just what was allocated since the
+ * mark, for code that borrows an Arena others are using too.
+ *
+ * An Arena has no lock: it belongs to whatever owns it, such as one
+ * MonteCarlo engine, and only that owner's thread allocates from it.
+ */
+class Arena
+{
+public:
+  static const size_t BLOCK_BYTES = 256 * 1024;
+
+  struct Mark
+  {
+  public:
+    size_t block;
+    size_t offset;
+    size_t used;
+  };
+
+public:
+  Arena(size_t blockBytes = BLOCK_BYTES);
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+public:
+  void* allocate(size_t bytes, size_t alignment);
+  template <typename T> T* allocate(size_t count)
+  {
+    static_assert(is_trivially_destructible<T>::value, "Arenas run no destructors");
+    return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+  }
+  void reset();
+  Mark mark() const { Mark m; m.block = current; m.offset = offset; m.used = used; return m; }
+  void rewind(const Mark& m);
+
+  size_t bytesUsed() const { return used; } // since the last reset
+  size_t peakBytes() const { return peak; } // the most ever in use at once
+  size_t bytesReserved() const { return reserved; } // blocks held
+
+private:
+  struct Block
+  {
+  public:
+    unique_ptr<char[]> memory;
+    size_t size;
+  };
+
+private:
+  size_t blockBytes;
+  vector<Block> blocks;
+  size_t current; // the block being bumped through
+  size_t offset; // into it
+  size_t used;
+  size_t peak;
+  size_t reserved;
+};
+
+/*
+ * NodePool is a fixed-capacity array for tree nodes, allocated once and
+ * addressed by 32-bit index rather than by pointer: half the size, and
+ * still good when the pool is compacted. allocate() hands out runs of
+ * consecutive nodes, such as a node's children, by bumping an atomic
+ * count, so any number of threads allocate without a lock; nothing is
+ * freed by itself, only everything past a prefix at once by reset().
+ * Once the pool is full, allocate() returns NONE.
+ */
+template <typename T>
+class NodePool
+{
+public:
+  static const uint32_t NONE = UINT32_MAX;
+
+public:
+  NodePool(size_t megabytes)
+    : used(0)
+  {
+    uint64_t count = ((uint64_t)max(megabytes, (size_t)1) << 20) / sizeof(T);
+    limit = (uint32_t)min(count, (uint64_t)NONE - 1);
+    nodes.reset(new T[limit]);
+  }
+
+  NodePool(const NodePool&) = delete;
+  NodePool& operator=(const NodePool&) = delete;
+
+public:
+  uint32_t allocate(uint32_t count)
+  {
+    // Once full, stop claiming, so that the count can't wrap around
+    if (used.load(memory_order_relaxed) >= limit)
+      return NONE;
+    uint32_t first = used.fetch_add(count, memory_order_relaxed);
+    if (first >= limit || limit - first < count)
+      return NONE;
+    return first;
+  }
+  void reset(uint32_t keep = 0) { used = keep; }
+
+  T& operator[](uint32_t i) { return nodes[i]; }
+  const T& operator[](uint32_t i) const { return nodes[i]; }
+
+  uint32_t size() const { return min(used.load(memory_order_relaxed), limit); }
+  uint32_t capacity() const { return limit; }
+  size_t bytesUsed() const { return (size_t)size() * sizeof(T); }
+  size_t bytesReserved() const { return (size_t)limit * sizeof(T); }
+
+private:
+  unique_ptr<T[]> nodes;
+  uint32_t limit;
+  atomic<uint32_t> used;
+};
+
+template <typename T> const uint32_t NodePool<T>::NONE;
@@ -1,5 +1,7 @@
 #include "Board.h"
 
+#include <algorithm>
+#include <cctype>
 #include <iostream>
 
 const Piece Piece::NONE(-1, -1);
@@ -24,8 +26,10 @@ bool operator!=(const Board::Coord& lhs, const Board::Coord& rhs)
 }
 
 Board::Board()
-  : a(8), b(8), c(8), d(8), e(8), f(8), g(8), h(8), verbose(false)
+  : drawPlies(DRAW_PLIES), verbose(false)
 {
+  clear();
+
   // now set up a normal 2-player game
   set(Piece(1), Coord('a', 1));
   set(Piece(1), Coord('a', 3));
@@ -56,60 +60,99 @@ Board::Board()
   setPlayerDirection(2, Direction::H_TO_A);
 }
 
-Board::~Board()
+int Board::squareOf(const Coord& coord)
+{
+  if (coord.row < 'a' || coord.row > 'h')
+    return NO_SQUARE;
+
+  int row = coord.row - 'a';
+  int col = normalizeColumn(coord.col);
+
+  // Light squares are never played on
+  if ((row + col) % 2 != 0)
+    return NO_SQUARE;
+
+  return row * 4 + col / 2;
+}
+Board::Coord Board::coordOf(int square)
+{
+  int row = square / 4;
+  int col = (square % 4) * 2 + (row % 2);
+  return Coord((char)('a' + row), col + 1);
+}
+
+string Board::squareName(int square)
 {
+  Coord c = coordOf(square);
+  return string(1, c.row) + to_string(c.col);
 }
 
 void Board::clear()
 {
-  for (int i=0; i<8; i++)
-  {
-    a[i] = Piece::NONE;
-    b[i] = Piece::NONE;
-    c[i] = Piece::NONE;
-    d[i] = Piece::NONE;
-    e[i] = Piece::NONE;
-    f[i] = Piece::NONE;
-    g[i] = Piece::NONE;
-    h[i] = Piece::NONE;
-    playerDirections.clear();
-  }
+  for (int i=0; i<MAX_PLAYERS; i++)
+    pieces[i] = 0;
+  reversed = 0;
+  kings = 0;
+  turn = 1;
+  quietPlies = 0;
+  refresh();
 }
 Piece Board::get(const Coord& coord)
 {
-  int col = normalizeColumn(coord.col);
+  if (coord.row < 'a' || coord.row > 'h')
+    throw "Unrecognized row request";
+
+  int square = squareOf(coord);
+  if (square == NO_SQUARE)
+    return Piece::NONE;
 
   // Find it
-  switch (coord.row)
+  uint32_t bit = 1u << square;
+  for (int p=0; p<MAX_PLAYERS; p++)
   {
-    case 'a': return a[col];
-    case 'b': return b[col];
-    case 'c': return c[col];
-    case 'd': return d[col];
-    case 'e': return e[col];
-    case 'f': return f[col];
-    case 'g': return g[col];
-    case 'h': return h[col];
-    default:
-      throw "Unrecognized row request";
+    if (pieces[p] & bit)
+      return Piece(p, (kings & bit) ? 1 : 0);
   }
+  return Piece::NONE;
 }
 void Board::set(Piece piece, const Coord& coord)
 {
-  int col = normalizeColumn(coord.col);
-  switch (coord.row)
+  if (coord.row < 'a' || coord.row > 'h')
+    throw "Unrecognized row request";
+
+  int square = squareOf(coord);
+  if (square == NO_SQUARE)
   {
-    case 'a': a[col] = piece; break;
-    case 'b': b[col] = piece; break;
-    case 'c': c[col] = piece; break;
-    case 'd': d[col] = piece; break;
-    case 'e': e[col] = piece; break;
-    case 'f': f[col] = piece; break;
-    case 'g': g[col] = piece; break;
-    case 'h': h[col] = piece; break;
-    default:
-      throw "Unrecognized row request";
+    // Nothing can stand on a light square, so clearing one is a no-op
+    if (piece == Piece::NONE)
+      return;
+    throw "Unrecognized square request";
   }
+
+  if (piece != Piece::NONE &&
+      (piece.player < 0 || piece.player >= MAX_PLAYERS ||
+       piece.rank < 0 || piece.rank > 1))
+    throw "Unrecognized piece request";
+
+  // A hand-made position has no history to repeat or count from
+  quietPlies = 0;
+
+  uint32_t bit = 1u << square;
+  int owner = ownerOf(bit);
+  if (owner != -1)
+  {
+    toggle(owner, (kings & bit) ? 1 : 0, square);
+    pieces[owner] &= ~bit;
+    kings &= ~bit;
+  }
+
+  if (piece == Piece::NONE)
+    return;
+
+  pieces[piece.player] |= bit;
+  if (piece.isKing())
+    kings |= bit;
+  toggle(piece.player, piece.rank, square);
 }
 int Board::normalizeColumn(int col)
 {
@@ -125,220 +168,663 @@ int Board::normalizeColumn(int col)
   return col;
 }
 
-bool Board::isStalemate()
+bool Board::isStalemate() const
 {
-  return false;
+  return drawPlies > 0 && quietPlies >= drawPlies;
 }
-int Board::isPlayerVictory()
+int Board::isPlayerVictory() const
 {
+  if (playerPiecesRemaining(turn) == 0 || mobility(turn) == 0)
+    return opponent(turn);
   return -1;
 }
+uint32_t Board::exactKey() const
+{
+  return (uint32_t)((key ^ ZOBRIST_TURN[turn]) >> 32);
+}
 
-void Board::setPlayerDirection(int player, Direction dir)
+void Board::setSideToMove(int player)
 {
-  playerDirections[player] = dir;
+  if (player < 0 || player >= MAX_PLAYERS)
+    throw "Unrecognized player request";
+  turn = player;
 }
-bool Board::isLastRow(const Piece& p, const Coord& c)
+
+uint64_t Board::hash(int symmetry) const
 {
-  Direction dir = playerDirections[p.player];
-  if ( (dir == Direction::A_TO_H) && (c.row == 'h') )
-    return true;
-  if ( (dir == Direction::H_TO_A) && (c.row == 'a') )
-    return true;
-  return false;
+  return (symmetry == 0 ? key : keyOf(symmetry)) ^ ZOBRIST_TURN[turn];
 }
-bool Board::legalMove(const Coord& constFrom, const Coord& constTo)
+uint64_t Board::computeHash() const
 {
-  Coord from = const_cast<Coord&>(constFrom);
-  Coord to = const_cast<Coord&>(constTo);
-
-  // Are we moving from and to the same place?
-  if (from == to)
-    return false;
-
-  // Is there a piece at "from"? (Can't move a piece if it doesn't exist)
-  Piece movingPiece = get(from);
-  if (movingPiece == Piece::NONE)
-    return false;
-
-  // Is there a piece at "to"? (Can't land in an occupied square)
-  if (get(to) != Piece::NONE)
-    return false;
-
-  // Is this piece a Pawn or a King?
-  if (movingPiece.isPawn())
-  { // This is a Pawn -- it can only move forwards
-    Direction playerDir = playerDirections[movingPiece.player];
-    
-    // Is "to" one space away on the diagonals?
-    if (playerDir == A_TO_H && 
-        ( (to == from.lowerRight()) || (to == from.lowerLeft()) )
-       )
+  return keyOf(symmetry()) ^ ZOBRIST_TURN[turn];
+}
+uint64_t Board::keyOf(int symmetry) const
+{
+  // The key the image would keep, from its masks
+  uint32_t k = transformMask(symmetry, kings);
+  uint64_t retval = 0;
+  for (int p=0; p<MAX_PLAYERS; p++)
+  {
+    for (uint32_t m = transformMask(symmetry, pieces[p]); m; m &= m - 1)
     {
-      return true;
+      int square = __builtin_ctz(m);
+      retval ^= ZOBRIST[p][(k >> square) & 1][square];
     }
-    if (playerDir == H_TO_A &&
-        ( (to == from.upperRight()) || (to == from.upperLeft()) )
-       )
+  }
+  return retval;
+}
+
+// Rows a-h are squares 0-31 four at a time, so a pawn's rows from row a
+// add up from these bits of its row number
+static const uint32_t ROW_BIT_0 = 0xF0F0F0F0u;
+static const uint32_t ROW_BIT_1 = 0xFF00FF00u;
+static const uint32_t ROW_BIT_2 = 0xFFFF0000u;
+
+int Board::feature(int player, Feature f) const
+{
+  uint32_t pawns = pieces[player] & ~kings;
+  // The home row is the one facing the pawns' last row
+  bool backwards = getPlayerDirection(player) == Direction::H_TO_A;
+  switch (f)
+  {
+    case PAWNS:
+      return __builtin_popcount(pawns);
+    case KINGS:
+      return __builtin_popcount(pieces[player] & kings);
+    case ADVANCEMENT:
     {
-      return true;
+      int rows = __builtin_popcount(pawns & ROW_BIT_0) + 2 * __builtin_popcount(pawns & ROW_BIT_1) +
+        4 * __builtin_popcount(pawns & ROW_BIT_2);
+      return backwards ? 7 * __builtin_popcount(pawns) - rows : rows;
     }
+    default:
+      return __builtin_popcount(pawns & lastRowOf(backwards ? A_TO_H : H_TO_A));
+  }
+}
+
+int Board::transformSquare(int symmetry, int square)
+{
+  return SYMMETRIC_SQUARE[symmetry][square];
+}
+uint32_t Board::transformMask(int symmetry, uint32_t m)
+{
+  if (symmetry & 4)
+  {
+    // Even rows keep columns 1 and 5 and swap 3 with 7; odd rows
+    // reverse their nibble
+    uint32_t even = (m & 0x05050505u) | ((m & 0x02020202u) << 2) | ((m & 0x08080808u) >> 2);
+    uint32_t odd = ((m & 0x10101010u) << 3) | ((m & 0x20202020u) << 1) |
+      ((m & 0x40404040u) >> 1) | ((m & 0x80808080u) >> 3);
+    m = even | odd;
+  }
+  for (int r=0; r<(symmetry & 3); r++)
+    m = rotateRowsLeft(m);
+  return m;
+}
+Board::Move Board::transformMove(int symmetry, const Move& m)
+{
+  if (m.isJump())
+    return Move::chain(SYMMETRIC_SQUARE[symmetry][m.from()], SYMMETRIC_SQUARE[symmetry][m.to()],
+      SYMMETRIC_SQUARE[symmetry][m.jumped()], transformMask(symmetry, m.captures));
+  if (m == Move())
+    return m;
+  return Move(SYMMETRIC_SQUARE[symmetry][m.from()], SYMMETRIC_SQUARE[symmetry][m.to()]);
+}
 
-    // Is "to" two spaces away on the diagonals, is that space empty,
-    // and is there a piece in between?
-    if (playerDir == A_TO_H)
+int Board::symmetry() const
+{
+  // Compare images mask by mask, transforming the later masks only
+  // while the earlier ones tie
+  const uint32_t masks[4] = { pieces[1], pieces[2], kings, pieces[0] };
+  uint32_t best[4];
+  for (int i=0; i<4; i++)
+    best[i] = masks[i];
+
+  int bestSymmetry = 0;
+  for (int t=1; t<SYMMETRIES; t++)
+  {
+    for (int i=0; i<4; i++)
     {
-      if (to == from.lowerRight().lowerRight() && 
-          get(from.lowerRight()).player != movingPiece.player)
+      uint32_t m = transformMask(t, masks[i]);
+      if (m > best[i])
+        break;
+      if (m < best[i])
       {
-        // This is a jump
-        return true;
-      }
-      if (to == from.lowerLeft().lowerLeft() && 
-          get(from.lowerLeft()).player != movingPiece.player)
-      {
-        // This is a jump
-        return true;
+        bestSymmetry = t;
+        best[i] = m;
+        for (int j=i+1; j<4; j++)
+          best[j] = transformMask(t, masks[j]);
+        break;
       }
     }
-    if (playerDir == H_TO_A)
+  }
+  return bestSymmetry;
+}
+int Board::canonicalize()
+{
+  int t = symmetry();
+  if (t != 0)
+    transform(t);
+  return t;
+}
+void Board::transform(int symmetry)
+{
+  for (int p=0; p<MAX_PLAYERS; p++)
+    pieces[p] = transformMask(symmetry, pieces[p]);
+  kings = transformMask(symmetry, kings);
+  refresh();
+}
+void Board::refresh()
+{
+  key = keyOf(0);
+}
+
+void Board::setPlayerDirection(int player, Direction dir)
+{
+  if (player < 0 || player >= MAX_PLAYERS)
+    throw "Unrecognized player request";
+  if (dir == H_TO_A)
+    reversed |= (uint8_t)(1 << player);
+  else
+    reversed &= (uint8_t)~(1 << player);
+}
+bool Board::legalMove(const Coord& from, const Coord& to)
+{
+  // Rows off the board are an error, as get() reports them
+  if (from.row < 'a' || from.row > 'h' || to.row < 'a' || to.row > 'h')
+    throw "Unrecognized row request";
+
+  Move m;
+  return legalMove(squareOf(from), squareOf(to), m);
+}
+bool Board::legalMove(int from, int to, Move& m) const
+{
+  // Any player's piece may move: a pawn only forwards, a king either
+  // way, a step onto an empty square or a chain of jumps over other
+  // players' pieces, which it must take if that player can capture
+  if (from < 0 || from >= SQUARES || to < 0 || to >= SQUARES)
+    return false;
+  uint32_t fromBit = 1u << from;
+  int player = ownerOf(fromBit);
+  uint32_t occupied = occupiedMask();
+  if (player == -1 || (to != from && (occupied & (1u << to)) != 0))
+    return false;
+
+  uint32_t others = occupied & ~pieces[player];
+  uint32_t canJump = (getPlayerDirection(player) == A_TO_H) ?
+    jumpers<A_TO_H>(pieces[player], others, ~occupied) :
+    jumpers<H_TO_A>(pieces[player], others, ~occupied);
+  if (canJump)
+  {
+    MoveList chains;
+    addChains(player, from, others, ~occupied | fromBit, chains);
+    for (int i=0; i<chains.size(); i++)
     {
-      if (to == from.upperRight().upperRight() &&
-          get(from.upperRight()).player != movingPiece.player)
+      if (chains[i].to() == to)
       {
-        // This is a jump
-        return true;
-      }
-      if (to == from.upperLeft().upperLeft() && 
-          get(from.upperLeft()).player != movingPiece.player)
-      {
-        // This is a jump
+        m = chains[i];
         return true;
       }
     }
+    return false;
   }
-  else 
-  { // This is a King -- it can move backwards
-
-    // Is "to" one space away on the diagonals, and is that space empty?
-    if (
-        (to == from.upperRight()) || (to == from.upperLeft()) ||
-        (to == from.lowerRight()) || (to == from.lowerLeft())
-       )
-    {
-      return true;
-    }
 
-    // Is "to" two spaces away on the diagonals
-    // and is there a piece in between?
-    if (to == from.upperRight().upperRight() &&
-        get(from.upperRight()).player != movingPiece.player)
-    {
-      // This is a jump
-      return true;
-    }
-    if (to == from.upperLeft().upperLeft() && 
-        get(from.upperLeft()).player != movingPiece.player)
-    {
-      // This is a jump
-      return true;
-    }
-    if (to == from.lowerRight().lowerRight() && 
-        get(from.lowerRight()).player != movingPiece.player)
-    {
-      // This is a jump
+  if (kings & fromBit)
+    return steps<A_TO_H, true>(from, to, m);
+  if (getPlayerDirection(player) == A_TO_H)
+    return steps<A_TO_H, false>(from, to, m);
+  return steps<H_TO_A, false>(from, to, m);
+}
+bool Board::isLegal(const Move& m) const
+{
+  int player = ownerOf(1u << m.from());
+  if (player == -1)
+    return false;
+  MoveList list;
+  generateMoves(player, list);
+  for (int i=0; i<list.size(); i++)
+  {
+    if (list[i] == m)
       return true;
-    }
-    if (to == from.lowerLeft().lowerLeft() && 
-        get(from.lowerLeft()).player != movingPiece.player)
+  }
+  return false;
+}
+template <Board::Direction dir, bool king>
+bool Board::steps(int from, int to, Move& m)
+{
+  // Pawns moving A_TO_H use the two lower diagonals, pawns moving
+  // H_TO_A the two upper ones; kings use all four
+  const int first = (king || dir == H_TO_A) ? UPPER_RIGHT : LOWER_RIGHT;
+  const int last = (king || dir == A_TO_H) ? LOWER_LEFT : UPPER_LEFT;
+  for (int d=first; d<=last; d++)
+  {
+    if (STEP[from][d] == to)
     {
-      // This is a jump
+      m = Move(from, to);
       return true;
     }
   }
-
   return false;
 }
-bool Board::move(const Coord& cfrom, const Coord& cto)
-{
-  Coord from = const_cast<Coord&>(cfrom);
-  Coord to = const_cast<Coord&>(cto);
 
+bool Board::move(const Coord& from, const Coord& to)
+{
   if (verbose)
     cout << "MOVE: " << from.row << from.col << 
       " TO " << to.row << to.col << endl;
 
-  if (!legalMove(from, to))
+  if (from.row < 'a' || from.row > 'h' || to.row < 'a' || to.row > 'h')
+    throw "Unrecognized row request";
+  Move m;
+  if (!legalMove(squareOf(from), squareOf(to), m))
   {
     if (verbose) cout << "*** REJECTED" << endl;
     return false;
   }
 
-  Piece piece = get(from);
+  // A jump's pieces get removed, and a Pawn that reaches the other
+  // player's side of the board becomes a King; makeMove() does both
+  if (verbose && m.isJump()) cout << "JUMP!!" << endl;
+  makeMove(m);
 
-  // Is this a jump?
-  if (from.row - to.row == 2 ||
-      from.row - to.row == -2)
+  if (verbose) cout << dump() << endl;
+
+  return true;
+}
+
+void Board::generateMoves(int player, MoveList& list) const
+{
+  list.clear();
+
+  uint32_t occupied = occupiedMask();
+  uint32_t movers = pieces[player];
+  if (getPlayerDirection(player) == Direction::A_TO_H)
+    generate<A_TO_H>(movers, occupied & ~movers, ~occupied, list);
+  else
+    generate<H_TO_A>(movers, occupied & ~movers, ~occupied, list);
+}
+int Board::mobility(int player) const
+{
+  uint32_t occupied = occupiedMask();
+  uint32_t movers = pieces[player];
+  if (getPlayerDirection(player) == Direction::A_TO_H)
+    return countMoves<A_TO_H>(movers, occupied & ~movers, ~occupied);
+  return countMoves<H_TO_A>(movers, occupied & ~movers, ~occupied);
+}
+template <Board::Direction dir>
+int Board::countMoves(uint32_t movers, uint32_t opponents, uint32_t empty) const
+{
+  // As generate(), but only counting, and a capture chain only by its
+  // first jump: every landing or target square along one diagonal is
+  // a different move
+  uint32_t upper = (dir == H_TO_A) ? movers : movers & kings;
+  uint32_t lower = (dir == A_TO_H) ? movers : movers & kings;
+  int jumps =
+    __builtin_popcount(shift(UPPER_RIGHT, shift(UPPER_RIGHT, upper) & opponents) & empty) +
+    __builtin_popcount(shift(UPPER_LEFT, shift(UPPER_LEFT, upper) & opponents) & empty) +
+    __builtin_popcount(shift(LOWER_RIGHT, shift(LOWER_RIGHT, lower) & opponents) & empty) +
+    __builtin_popcount(shift(LOWER_LEFT, shift(LOWER_LEFT, lower) & opponents) & empty);
+  if (jumps)
+    return jumps;
+  return
+    __builtin_popcount(shift(UPPER_RIGHT, upper) & empty) +
+    __builtin_popcount(shift(UPPER_LEFT, upper) & empty) +
+    __builtin_popcount(shift(LOWER_RIGHT, lower) & empty) +
+    __builtin_popcount(shift(LOWER_LEFT, lower) & empty);
+}
+template <Board::Direction dir>
+uint32_t Board::jumpers(uint32_t movers, uint32_t opponents, uint32_t empty) const
+{
+  // Walk back from every empty square over an opponent: whoever is
+  // there, and may move that way, can jump
+  uint32_t upper = (dir == H_TO_A) ? movers : movers & kings;
+  uint32_t lower = (dir == A_TO_H) ? movers : movers & kings;
+  uint32_t upperRight = shift(LOWER_LEFT, shift(LOWER_LEFT, empty) & opponents);
+  uint32_t upperLeft = shift(LOWER_RIGHT, shift(LOWER_RIGHT, empty) & opponents);
+  uint32_t lowerRight = shift(UPPER_LEFT, shift(UPPER_LEFT, empty) & opponents);
+  uint32_t lowerLeft = shift(UPPER_RIGHT, shift(UPPER_RIGHT, empty) & opponents);
+  return ((upperRight | upperLeft) & upper) | ((lowerRight | lowerLeft) & lower);
+}
+void Board::addChains(int player, int from, uint32_t opponents, uint32_t empty, MoveList& list) const
+{
+  int start = list.size();
+  if (kings & (1u << from))
+    addChains<A_TO_H, true>(from, from, NO_SQUARE, 0, opponents, empty, list, start);
+  else if (getPlayerDirection(player) == A_TO_H)
+    addChains<A_TO_H, false>(from, from, NO_SQUARE, 0, opponents, empty, list, start);
+  else
+    addChains<H_TO_A, false>(from, from, NO_SQUARE, 0, opponents, empty, list, start);
+}
+template <Board::Direction dir, bool king>
+void Board::addChains(int from, int square, int first, uint32_t captured,
+  uint32_t opponents, uint32_t empty, MoveList& list, int start)
+{
+  // Jump on from square while any jump is left. empty counts the
+  // square the piece set out from; captured pieces still block
+  const int firstDiagonal = (king || dir == H_TO_A) ? UPPER_RIGHT : LOWER_RIGHT;
+  const int lastDiagonal = (king || dir == A_TO_H) ? LOWER_LEFT : UPPER_LEFT;
+  bool extended = false;
+  for (int d=firstDiagonal; d<=lastDiagonal; d++)
   {
-    // This is a jump; remove that piece
-    if (verbose) cout << "JUMP!!" << endl;
-    if (to == from.upperRight().upperRight())
-    {
-      set(Piece::NONE, from.upperRight());
-    }
-    if (to == from.upperLeft().upperLeft())
+    int over = JUMPED[square][d];
+    if (over == NO_SQUARE)
+      continue;
+    uint32_t overBit = 1u << over;
+    if ((opponents & ~captured & overBit) == 0 || (empty & (1u << JUMP[square][d])) == 0)
+      continue;
+    extended = true;
+    addChains<dir, king>(from, JUMP[square][d], first == NO_SQUARE ? over : first,
+      captured | overBit, opponents, empty, list, start);
+  }
+  if (extended || captured == 0)
+    return;
+
+  // Chains that take the same pieces to the same square are one move
+  Move m = Move::chain(from, square, first, captured);
+  for (int i=start; i<list.size(); i++)
+  {
+    if (list[i] == m)
+      return;
+  }
+  if (list.size() < MoveList::CAPACITY)
+    list.add(m);
+}
+template <Board::Direction dir>
+void Board::generate(uint32_t movers, uint32_t opponents, uint32_t empty, MoveList& list) const
+{
+  // Capturing is compulsory, so while any piece can jump the moves
+  // are its capture chains and nothing else
+  uint32_t canJump = jumpers<dir>(movers, opponents, empty);
+  while (canJump)
+  {
+    int from = __builtin_ctz(canJump);
+    canJump &= canJump - 1;
+    uint32_t fromBit = 1u << from;
+    if (kings & fromBit)
+      addChains<dir, true>(from, from, NO_SQUARE, 0, opponents, empty | fromBit, list, list.size());
+    else
+      addChains<dir, false>(from, from, NO_SQUARE, 0, opponents, empty | fromBit, list, list.size());
+  }
+  if (!list.empty())
+    return;
+
+  // Pawns only move towards the far row; kings move every way
+  uint32_t upper = (dir == H_TO_A) ? movers : movers & kings;
+  uint32_t lower = (dir == A_TO_H) ? movers : movers & kings;
+  addSteps<UPPER_RIGHT>(upper, empty, list);
+  addSteps<UPPER_LEFT>(upper, empty, list);
+  addSteps<LOWER_RIGHT>(lower, empty, list);
+  addSteps<LOWER_LEFT>(lower, empty, list);
+}
+template <Board::Diagonal d>
+void Board::addSteps(uint32_t sources, uint32_t empty, MoveList& list)
+{
+  uint32_t targets = shift(d, sources) & empty;
+  while (targets)
+  {
+    int to = __builtin_ctz(targets);
+    targets &= targets - 1;
+    list.add(Move(STEP[to][opposite(d)], to));
+  }
+}
+
+bool Board::findMove(const Coord& from, const Coord& to, Move& m) const
+{
+  int fromSquare = squareOf(from);
+  int toSquare = squareOf(to);
+  if (fromSquare == NO_SQUARE || toSquare == NO_SQUARE)
+    return false;
+
+  int player = ownerOf(1u << fromSquare);
+  if (player == -1)
+    return false;
+
+  MoveList list;
+  generateMoves(player, list);
+  for (int i=0; i<list.size(); i++)
+  {
+    if (list[i].from() == fromSquare && list[i].to() == toSquare)
     {
-      set(Piece::NONE, from.upperLeft());
+      m = list[i];
+      return true;
     }
-    if (to == from.lowerRight().lowerRight())
+  }
+  return false;
+}
+string Board::moveName(const Move& m)
+{
+  // Same form the console shell accepts, e.g. "c1,d2"
+  return squareName(m.from()) + "," + squareName(m.to());
+}
+int Board::ownerOf(uint32_t bit) const
+{
+  for (int p=0; p<MAX_PLAYERS; p++)
+  {
+    if (pieces[p] & bit)
+      return p;
+  }
+  return -1;
+}
+Board::Undo Board::makeMove(const Move& m)
+{
+  Undo undo;
+  undo.turn = turn;
+  undo.quietPlies = quietPlies;
+
+  uint32_t fromBit = 1u << m.from();
+  uint32_t toBit = 1u << m.to();
+  int player = ownerOf(fromBit);
+
+  if (m.isJump())
+  {
+    // The whole chain's captures come off together
+    undo.capturedKings = kings & m.captures;
+    for (int p=0; p<MAX_PLAYERS; p++)
     {
-      set(Piece::NONE, from.lowerRight());
+      uint32_t lost = pieces[p] & m.captures;
+      undo.captured[p] = lost;
+      pieces[p] &= ~lost;
+      for (; lost; lost &= lost - 1)
+      {
+        int square = __builtin_ctz(lost);
+        toggle(p, (undo.capturedKings >> square) & 1, square);
+      }
     }
-    if (to == from.lowerLeft().lowerLeft())
+    kings &= ~m.captures;
+  }
+
+  // A king's chain can come back round to where it started, so from
+  // and to may be the same square
+  pieces[player] ^= fromBit ^ toBit;
+  quietPlies = m.isJump() ? 0 : (int16_t)(quietPlies + 1);
+  if (kings & fromBit)
+  {
+    kings ^= fromBit ^ toBit;
+    toggle(player, 1, m.from());
+    toggle(player, 1, m.to());
+  }
+  else if (toBit & lastRowOf(getPlayerDirection(player)))
+  {
+    kings |= toBit;
+    undo.promoted = true;
+    toggle(player, 0, m.from());
+    toggle(player, 1, m.to());
+    quietPlies = 0;
+  }
+  else
+  {
+    toggle(player, 0, m.from());
+    toggle(player, 0, m.to());
+    quietPlies = 0;
+  }
+
+  turn = opponent(player);
+
+  return undo;
+}
+void Board::unmakeMove(const Move& m, const Undo& undo)
+{
+  uint32_t fromBit = 1u << m.from();
+  uint32_t toBit = 1u << m.to();
+  int player = ownerOf(toBit);
+
+  bool king = (kings & toBit) != 0;
+  if (king && !undo.promoted)
+  {
+    toggle(player, 1, m.to());
+    toggle(player, 1, m.from());
+  }
+  else
+  {
+    toggle(player, king, m.to());
+    toggle(player, 0, m.from());
+  }
+  if (undo.promoted)
+    kings &= ~toBit;
+  pieces[player] ^= fromBit ^ toBit;
+  if (kings & toBit)
+    kings ^= fromBit ^ toBit;
+
+  if (m.isJump())
+  {
+    kings |= undo.capturedKings;
+    for (int p=0; p<MAX_PLAYERS; p++)
     {
-      set(Piece::NONE, from.lowerLeft());
+      pieces[p] |= undo.captured[p];
+      for (uint32_t lost = undo.captured[p]; lost; lost &= lost - 1)
+      {
+        int square = __builtin_ctz(lost);
+        toggle(p, (undo.capturedKings >> square) & 1, square);
+      }
     }
   }
-  set(Piece::NONE, from);
-  set(piece, to);
 
-  // If this piece has reached the other player's side of the
-  // board, and if this piece is a Pawn, it is now promoted
-  // to be a King
-  if ( (piece.isPawn()) && isLastRow(piece, to) )
+  turn = undo.turn;
+  quietPlies = undo.quietPlies;
+}
+
+string Board::position() const
+{
+  string retval = to_string(turn) + ":";
+  for (int sq=0; sq<SQUARES; sq++)
   {
-    set(Piece(piece.player, 1), to);
+    if (sq > 0 && sq % 4 == 0)
+      retval += "/";
+    uint32_t bit = 1u << sq;
+    char c = '.';
+    if (pieces[1] & bit) c = 'x';
+    if (pieces[2] & bit) c = 'o';
+    if (kings & bit) c = (char)toupper(c);
+    retval += c;
   }
+  return retval;
+}
+void Board::setPosition(const string& pos)
+{
+  if (pos.size() < 2 || pos[1] != ':' || (pos[0] != '1' && pos[0] != '2'))
+    throw "Unrecognized position request";
 
-  if (verbose) cout << dump() << endl;
+  clear();
+  setPlayerDirection(1, Direction::A_TO_H);
+  setPlayerDirection(2, Direction::H_TO_A);
 
-  return true;
+  int sq = 0;
+  for (size_t i=2; i<pos.size(); i++)
+  {
+    char c = pos[i];
+    if (c == '/')
+      continue;
+    if (sq >= SQUARES)
+      throw "Unrecognized position request";
+
+    Coord coord = coordOf(sq++);
+    switch (c)
+    {
+      case '.': break;
+      case 'x': set(Piece(1), coord); break;
+      case 'X': set(Piece(1, 1), coord); break;
+      case 'o': set(Piece(2), coord); break;
+      case 'O': set(Piece(2, 1), coord); break;
+      default:
+        throw "Unrecognized position request";
+    }
+  }
+  if (sq != SQUARES)
+    throw "Unrecognized position request";
+
+  setSideToMove(pos[0] - '0');
+}
+
+void Board::setMasks(uint32_t player1, uint32_t player2, uint32_t kingMask, int side)
+{
+  // The same normal game setPosition() makes, straight from masks
+  clear();
+  setPlayerDirection(1, Direction::A_TO_H);
+  setPlayerDirection(2, Direction::H_TO_A);
+  pieces[1] = player1;
+  pieces[2] = player2 & ~player1;
+  kings = kingMask & (pieces[1] | pieces[2]);
+  turn = side;
+  refresh();
 }
 
 string Board::dump()
 {
   string retval = "Board: 1     2     3     4     5     6     7     8\n";
 
-  retval += "a" + dumpRow(a);
-  retval += "b" + dumpRow(b);
-  retval += "c" + dumpRow(c);
-  retval += "d" + dumpRow(d);
-  retval += "e" + dumpRow(e);
-  retval += "f" + dumpRow(f);
-  retval += "g" + dumpRow(g);
-  retval += "h" + dumpRow(h);
+  for (int row=0; row<8; row++)
+    retval += string(1, (char)('a' + row)) + dumpRow(row);
 
   return retval;
 }
-string Board::dumpRow(vector<Piece>& row)
+string Board::dumpRow(int row)
 {
   string retval = ":";
-  for (int i=0; i<8; i++)
-    retval += " || " + (row[i]).dump();
+  for (int i=1; i<=8; i++)
+    retval += " || " + get(Coord((char)('a' + row), i)).dump();
   retval += " ||\n";
   return retval;
 }
 
+constexpr int8_t Board::STEP[Board::SQUARES][4];
+constexpr int8_t Board::JUMP[Board::SQUARES][4];
+constexpr int8_t Board::JUMPED[Board::SQUARES][4];
+
+// a1 steps to b2, and wraps round to b8; h8 has nowhere further down
+static_assert(Board::STEP[0][Board::LOWER_RIGHT] == 4 && Board::STEP[0][Board::LOWER_LEFT] == 7,
+  "neighbour table wraps columns");
+static_assert(Board::STEP[31][Board::LOWER_LEFT] == Board::NO_SQUARE &&
+  Board::JUMP[27][Board::LOWER_RIGHT] == Board::NO_SQUARE, "neighbour table stops at row h");
+static_assert(Board::JUMP[0][Board::LOWER_LEFT] == 11 && Board::JUMPED[0][Board::LOWER_LEFT] == 7,
+  "jumps land two steps away");
+
+uint64_t Board::ZOBRIST[Board::MAX_PLAYERS][2][Board::SQUARES];
+uint64_t Board::ZOBRIST_TURN[Board::MAX_PLAYERS];
+uint8_t Board::SYMMETRIC_SQUARE[Board::SYMMETRIES][Board::SQUARES];
+bool Board::initZobrist()
+{
+  // splitmix64 from a fixed seed, so keys are the same on every run
+  uint64_t state = 0x436F6E436865636Bull;
+  auto next = [&state]() {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  };
+  for (int p=0; p<MAX_PLAYERS; p++)
+    for (int r=0; r<2; r++)
+      for (int sq=0; sq<SQUARES; sq++)
+        ZOBRIST[p][r][sq] = next();
+  for (int p=0; p<MAX_PLAYERS; p++)
+    ZOBRIST_TURN[p] = next();
+
+  for (int t=0; t<SYMMETRIES; t++)
+    for (int sq=0; sq<SQUARES; sq++)
+      SYMMETRIC_SQUARE[t][sq] = (uint8_t)__builtin_ctz(transformMask(t, 1u << sq));
+  return true;
+}
+bool Board::zobristReady = Board::initZobrist();
+
 const Board::Coord Board::A1('a',1);
 const Board::Coord Board::A2('a',2);
 const Board::Coord Board::A3('a',3);
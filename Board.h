@@ -1,9 +1,10 @@
 #pragma once
 
-#include <map>
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <tuple>
-#include <vector>
+#include <type_traits>
 using namespace std;
 
 struct Piece
@@ -37,6 +38,29 @@ public:
 };
 
 
+/*
+ * Neighbours works out, at compile time, where a step or jump along a
+ * diagonal takes a playable square (numbered as in Board::squareOf()),
+ * or -1 if it leaves the board through row a or h. Diagonals are
+ * numbered as Board::Diagonal. Board builds its lookup tables from it.
+ */
+struct Neighbours
+{
+public:
+  static constexpr int squareAt(int row, int col)
+  { return (row < 0 || row > 7) ? -1 : row * 4 + ((col % 8 + 8) % 8) / 2; }
+  static constexpr int rowStep(int d) { return d >= 2 ? 1 : -1; }
+  static constexpr int colStep(int d) { return (d % 2 == 0) ? 1 : -1; }
+  static constexpr int columnOf(int square) { return (square % 4) * 2 + (square / 4) % 2; }
+
+  static constexpr int step(int square, int d)
+  { return squareAt(square / 4 + rowStep(d), columnOf(square) + colStep(d)); }
+  static constexpr int jump(int square, int d)
+  { return squareAt(square / 4 + 2 * rowStep(d), columnOf(square) + 2 * colStep(d)); }
+  static constexpr int jumped(int square, int d)
+  { return jump(square, d) == -1 ? -1 : step(square, d); }
+};
+
 /*
  * Board is a checkerboard of rows and columns holding Pieces.
  * Empty squares are denoted by the constant Piece::NONE.
@@ -44,6 +68,22 @@ public:
  * Columns are numbered 1 through 8. Columns can "wrap", so that
  * a1 == a9 == a17 == a-7 == a=15. (This is what will make the
  * board a cylinder rather than a flat board.)
+ *
+ * Only the 32 dark squares (a1, a3, ... b2, b4, ...) can ever hold a
+ * piece, so the board is stored as 32-bit masks over those squares:
+ * one occupancy mask per player and one mask marking kings. Square
+ * index n is row (n / 4), and each row is a 4-bit nibble; moving a
+ * piece across the column seam is a rotation within that nibble.
+ * A Board is a plain, trivially copyable value of 32 bytes, so copying
+ * one is a few moves of registers; anything that can be worked out
+ * from the masks is, when asked for, rather than carried along. The
+ * game's earlier positions live in a PositionHistory, not here.
+ *
+ * Because columns wrap, shifting a whole position two columns around
+ * the cylinder, or mirroring it left to right, gives the same game.
+ * Those eight symmetries are numbered 0 (identity) to 7; see
+ * transformSquare(). hash() is the same for all eight images of a
+ * position, and canonicalize() picks one of them as the representative.
  */
 class Board
 {
@@ -90,9 +130,99 @@ public:
     A_TO_H, H_TO_A
   };
 
+  static const int SQUARES = 32;
+  static const int NO_SQUARE = -1;
+  static const int MAX_PLAYERS = 3; // players 1 and 2, and 0 for a custom third
+
+  static int squareOf(const Coord& coord);
+  static Coord coordOf(int square);
+  static string squareName(int square);
+
+  /*
+   * A Move is a step, or a chain of one or more jumps by one piece.
+   * bits packs from (5 bits), to (5 bits), the square the first jump
+   * goes over (5 bits) and a jump flag; captures marks every square
+   * the chain goes over, all of which makeMove() empties at once.
+   * Two moves are the same when they do the same thing: same squares
+   * and same captures, whichever way round the chain went. The
+   * transposition table keeps only bits, which is enough to pick the
+   * move out of the generated ones again.
+   */
+  struct Move
+  {
+  public:
+    uint16_t bits;
+    uint32_t captures;
+
+  public:
+    Move() : bits(0), captures(0) { }
+    Move(int f, int t) : bits((uint16_t)(f | (t << 5))), captures(0) { }
+    Move(int f, int t, int j)
+      : bits((uint16_t)(f | (t << 5) | (j << 10) | 0x8000)), captures(1u << j) { }
+
+  public:
+    static Move chain(int f, int t, int j, uint32_t c)
+    { Move m(f, t, j); m.captures = c; return m; }
+
+  public:
+    int from() const { return bits & 31; }
+    int to() const { return (bits >> 5) & 31; }
+    int jumped() const { return isJump() ? (bits >> 10) & 31 : NO_SQUARE; } // the first
+    bool isJump() const { return (bits & 0x8000) != 0; }
+    int jumps() const { return __builtin_popcount(captures); }
+
+  public:
+    friend bool operator==(const Move& lhs, const Move& rhs)
+    { return ((lhs.bits ^ rhs.bits) & 0x83FF) == 0 && lhs.captures == rhs.captures; }
+    friend bool operator!=(const Move& lhs, const Move& rhs)
+    { return !(lhs == rhs); }
+  };
+
+  /*
+   * Undo holds what makeMove() destroyed, so that unmakeMove() can put
+   * the board back exactly as it was.
+   */
+  struct Undo
+  {
+  public:
+    uint32_t captured[MAX_PLAYERS]; // each player's pieces the move took
+    uint32_t capturedKings;
+    int8_t turn; // side to move before the move
+    bool promoted;
+    int16_t quietPlies; // before the move
+
+  public:
+    Undo() : captured(), capturedKings(0), turn(-1), promoted(false), quietPlies(0) { }
+  };
+
+  /*
+   * MoveList is a fixed-capacity buffer the generator writes into, so
+   * enumerating moves never touches the heap. No player can ever have
+   * more than four steps per piece; capture chains that would not fit
+   * are dropped, which no real position comes near.
+   */
+  struct MoveList
+  {
+  public:
+    static const int CAPACITY = 4 * SQUARES;
+
+  public:
+    MoveList() : count(0) { }
+
+  public:
+    void clear() { count = 0; }
+    void add(const Move& m) { moves[count++] = m; }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    const Move& operator[](int i) const { return moves[i]; }
+
+  private:
+    Move moves[CAPACITY];
+    int count;
+  };
+
 public:
   Board();
-  ~Board();
 
   /*
    * Board state
@@ -102,25 +232,122 @@ public:
   Piece get(const Coord& coord);
   void set(Piece p, const Coord& coord);
 private:
-  int normalizeColumn(int col);
+  static int normalizeColumn(int col);
+
+  /*
+   * Game state. The side to move loses when it has no move (having no
+   * pieces left is the same thing). The game is drawn once drawPlies
+   * plies in a row have gone by without a capture or a pawn move, which
+   * makeMove() counts and set() starts afresh. It is also drawn when
+   * a position comes up for the third time, but that takes the game's
+   * earlier positions, which a PositionHistory keeps: see
+   * PositionHistory::isDraw().
+   */
+public:
+  static const int DRAW_PLIES = 80; // forty moves a side
+  bool isStalemate() const; // drawn by the quiet plies
+  int isPlayerVictory() const; // the winner, or -1
+  int getQuietPlies() const { return quietPlies; }
+  int getDrawPlies() const { return drawPlies; }
+  void setDrawPlies(int plies) { drawPlies = (int16_t)min(plies, 32767); } // 0 for no limit
+  int playerPiecesRemaining(int player) const { return __builtin_popcount(pieces[player]); }
+  int sideToMove() const { return turn; }
+  void setSideToMove(int player);
+  static int opponent(int player) { return 3 - player; } // 1 <-> 2
+
+  /*
+   * Evaluation features, per player: pawns, kings, the rows the pawns
+   * have advanced from their home row in total, and the pawns still
+   * guarding that home row. Evaluation weights them. mobility() is the
+   * number of steps the player has, or when it must capture the number
+   * of first jumps (not whole chains). All are counted from the masks
+   * when asked for, a few popcounts each, as PositionBatch counts them
+   * for many positions at once.
+   */
+public:
+  enum Feature
+  {
+    PAWNS, KINGS, ADVANCEMENT, BACK_ROW, FEATURES
+  };
+  int feature(int player, Feature f) const;
+  int mobility(int player) const;
+
+  /*
+   * Position identity: a Zobrist key over piece/square and side to
+   * move. The board keeps the key of the position as it stands, up to
+   * date in set() and makeMove(); the hash is the key of its
+   * representative (see symmetry()), which is the same for every image
+   * of the position. That is the board's own key when it is its own
+   * representative, and is worked out from the masks otherwise. A
+   * caller that already has symmetry() passes it in.
+   */
+public:
+  uint64_t hash() const { return hash(symmetry()); }
+  uint64_t hash(int symmetry) const;
+  uint64_t computeHash() const;
+  // The top half of this image's key and the turn, for telling
+  // repetitions apart, where the images of a position are not the same
+  uint32_t exactKey() const;
 
   /*
-   * Game state
+   * Symmetries: bit 2 mirrors the columns (column c becomes 10 - c),
+   * then bits 0-1 shift that many times two columns to the right.
+   * symmetry() is the one that takes this position to its
+   * representative: the image with the smallest masks, compared
+   * player 1, player 2, kings, player 0. Moves and squares
+   * from the representative come back through inverseSymmetry().
    */
 public:
-  bool isStalemate();
-  int isPlayerVictory();
-  int playerPiecesRemaining(int player);
+  static const int SYMMETRIES = 8;
+  static int transformSquare(int symmetry, int square);
+  static uint32_t transformMask(int symmetry, uint32_t m);
+  static Move transformMove(int symmetry, const Move& m);
+  static int inverseSymmetry(int symmetry)
+  { return (symmetry & 4) ? symmetry : (4 - symmetry) & 3; }
+  int symmetry() const;
+  int canonicalize();
+  void transform(int symmetry);
 
   /*
-   * Player piece movement
+   * Player piece movement. Pawns step or jump forwards only, kings
+   * either way. A player who can capture must. A capture is a chain:
+   * after each jump the piece jumps again while it can, around the
+   * cylinder as often as the pieces allow, and the chain ends where it
+   * runs out of jumps. Captured pieces stay on the board, so cannot be
+   * jumped twice, until the whole chain has been made; a pawn ending
+   * the chain on its last row is promoted then.
    */
 public:
   void setPlayerDirection(int player, Direction dir);
+  Direction getPlayerDirection(int player) const
+  { return ((reversed >> player) & 1) ? H_TO_A : A_TO_H; }
   bool legalMove(const Coord& from, const Coord& to);
+  bool legalMove(int from, int to, Move& m) const; // same rules, by square index
+  bool isLegal(const Move& m) const; // for the piece's owner, captures and all
   bool move(const Coord& from, const Coord& to);
+  void generateMoves(int player, MoveList& list) const;
+  bool findMove(const Coord& from, const Coord& to, Move& m) const;
+  static string moveName(const Move& m);
+  Undo makeMove(const Move& m);
+  void unmakeMove(const Move& m, const Undo& undo);
 private:
-  bool isLastRow(const Piece& p, const Coord& c);
+  int ownerOf(uint32_t bit) const;
+  void toggle(int player, int rank, int square) { key ^= ZOBRIST[player][rank][square]; }
+  void refresh();
+  uint64_t keyOf(int symmetry) const;
+  static uint32_t lastRowOf(Direction dir)
+  { return (dir == Direction::A_TO_H) ? 0xF0000000u : 0x0000000Fu; }
+
+  /*
+   * Position notation: side to move, a colon, then the 32 playable
+   * squares from a1 to h8 as '.' (empty), 'x'/'X' (player 1 pawn/king)
+   * or 'o'/'O' (player 2 pawn/king). A '/' may separate rows. Player 1
+   * moves A_TO_H and player 2 H_TO_A, as in a normal game.
+   */
+public:
+  string position() const;
+  void setPosition(const string& pos);
+  void setMasks(uint32_t player1, uint32_t player2, uint32_t kingMask, int side);
 
   /*
    * Diagnostics
@@ -130,21 +357,135 @@ public:
   void setVerbose() { verbose = true; }
   void clearVerbose() { verbose = false; }
 private:
-  string dumpRow(vector<Piece>& row);
-  bool verbose;
+  string dumpRow(int row);
+
+public:
+  /*
+   * Square masks
+   */
+  static const uint32_t EVEN_ROWS = 0x0F0F0F0Fu; // rows a, c, e, g
+  static const uint32_t ODD_ROWS = 0xF0F0F0F0u;  // rows b, d, f, h
+
+  // Rotate every row's nibble by one square, wrapping within the row,
+  // which moves every piece two columns
+  static uint32_t rotateRowsLeft(uint32_t m)
+  { return ((m << 1) & 0xEEEEEEEEu) | ((m >> 3) & 0x11111111u); }
+  static uint32_t rotateRowsRight(uint32_t m)
+  { return ((m >> 1) & 0x77777777u) | ((m << 3) & 0x88888888u); }
+
+  enum Diagonal
+  {
+    UPPER_RIGHT, UPPER_LEFT, LOWER_RIGHT, LOWER_LEFT
+  };
+  static constexpr Diagonal opposite(Diagonal d)
+  { return (Diagonal)(3 - d); }
+
+  // Move every square in the mask one step along a diagonal; squares
+  // that would leave the board through row a or h drop off
+  static uint32_t shift(Diagonal d, uint32_t m)
+  {
+    switch (d)
+    {
+      case UPPER_RIGHT:
+        return ((m & EVEN_ROWS) >> 4) | rotateRowsLeft((m & ODD_ROWS) >> 4);
+      case UPPER_LEFT:
+        return rotateRowsRight((m & EVEN_ROWS) >> 4) | ((m & ODD_ROWS) >> 4);
+      case LOWER_RIGHT:
+        return ((m & EVEN_ROWS) << 4) | rotateRowsLeft((m & ODD_ROWS) << 4);
+      default:
+        return rotateRowsRight((m & EVEN_ROWS) << 4) | ((m & ODD_ROWS) << 4);
+    }
+  }
+
+  /*
+   * Neighbour tables, built by the compiler: for every playable square
+   * and Diagonal, the square one step away, the square a jump lands
+   * on, and the square that jump passes over, with the column wrap
+   * applied and NO_SQUARE where the step would leave through row a
+   * or h. The per-square rules (legalMove(), move()) read these; the
+   * generator moves whole masks with shift() instead.
+   */
+  static constexpr int8_t STEP[SQUARES][4] = {
+#define NEIGHBOURS(sq) { Neighbours::step(sq, 0), Neighbours::step(sq, 1), Neighbours::step(sq, 2), Neighbours::step(sq, 3) }
+    NEIGHBOURS(0), NEIGHBOURS(1), NEIGHBOURS(2), NEIGHBOURS(3),
+    NEIGHBOURS(4), NEIGHBOURS(5), NEIGHBOURS(6), NEIGHBOURS(7),
+    NEIGHBOURS(8), NEIGHBOURS(9), NEIGHBOURS(10), NEIGHBOURS(11),
+    NEIGHBOURS(12), NEIGHBOURS(13), NEIGHBOURS(14), NEIGHBOURS(15),
+    NEIGHBOURS(16), NEIGHBOURS(17), NEIGHBOURS(18), NEIGHBOURS(19),
+    NEIGHBOURS(20), NEIGHBOURS(21), NEIGHBOURS(22), NEIGHBOURS(23),
+    NEIGHBOURS(24), NEIGHBOURS(25), NEIGHBOURS(26), NEIGHBOURS(27),
+    NEIGHBOURS(28), NEIGHBOURS(29), NEIGHBOURS(30), NEIGHBOURS(31)
+#undef NEIGHBOURS
+  };
+  static constexpr int8_t JUMP[SQUARES][4] = {
+#define NEIGHBOURS(sq) { Neighbours::jump(sq, 0), Neighbours::jump(sq, 1), Neighbours::jump(sq, 2), Neighbours::jump(sq, 3) }
+    NEIGHBOURS(0), NEIGHBOURS(1), NEIGHBOURS(2), NEIGHBOURS(3),
+    NEIGHBOURS(4), NEIGHBOURS(5), NEIGHBOURS(6), NEIGHBOURS(7),
+    NEIGHBOURS(8), NEIGHBOURS(9), NEIGHBOURS(10), NEIGHBOURS(11),
+    NEIGHBOURS(12), NEIGHBOURS(13), NEIGHBOURS(14), NEIGHBOURS(15),
+    NEIGHBOURS(16), NEIGHBOURS(17), NEIGHBOURS(18), NEIGHBOURS(19),
+    NEIGHBOURS(20), NEIGHBOURS(21), NEIGHBOURS(22), NEIGHBOURS(23),
+    NEIGHBOURS(24), NEIGHBOURS(25), NEIGHBOURS(26), NEIGHBOURS(27),
+    NEIGHBOURS(28), NEIGHBOURS(29), NEIGHBOURS(30), NEIGHBOURS(31)
+#undef NEIGHBOURS
+  };
+  static constexpr int8_t JUMPED[SQUARES][4] = {
+#define NEIGHBOURS(sq) { Neighbours::jumped(sq, 0), Neighbours::jumped(sq, 1), Neighbours::jumped(sq, 2), Neighbours::jumped(sq, 3) }
+    NEIGHBOURS(0), NEIGHBOURS(1), NEIGHBOURS(2), NEIGHBOURS(3),
+    NEIGHBOURS(4), NEIGHBOURS(5), NEIGHBOURS(6), NEIGHBOURS(7),
+    NEIGHBOURS(8), NEIGHBOURS(9), NEIGHBOURS(10), NEIGHBOURS(11),
+    NEIGHBOURS(12), NEIGHBOURS(13), NEIGHBOURS(14), NEIGHBOURS(15),
+    NEIGHBOURS(16), NEIGHBOURS(17), NEIGHBOURS(18), NEIGHBOURS(19),
+    NEIGHBOURS(20), NEIGHBOURS(21), NEIGHBOURS(22), NEIGHBOURS(23),
+    NEIGHBOURS(24), NEIGHBOURS(25), NEIGHBOURS(26), NEIGHBOURS(27),
+    NEIGHBOURS(28), NEIGHBOURS(29), NEIGHBOURS(30), NEIGHBOURS(31)
+#undef NEIGHBOURS
+  };
+
+  uint32_t playerMask(int player) const { return pieces[player]; }
+  uint32_t kingMask() const { return kings; }
+  uint32_t occupiedMask() const { return pieces[0] | pieces[1] | pieces[2]; }
 
 private:
   /*
-   * Row storage
+   * Square storage
+   */
+  uint32_t pieces[MAX_PLAYERS];
+  uint32_t kings;
+  uint64_t key; // pieces only; the turn is folded in by hash()
+  int16_t quietPlies; // since the last capture or pawn move
+  int16_t drawPlies;
+  int8_t turn;
+  uint8_t reversed; // bit p set: player p moves H_TO_A
+  bool verbose; // move() narrates
+
+  static uint64_t ZOBRIST[MAX_PLAYERS][2][SQUARES];
+  static uint64_t ZOBRIST_TURN[MAX_PLAYERS];
+  static uint8_t SYMMETRIC_SQUARE[SYMMETRIES][SQUARES];
+  static bool initZobrist();
+  static bool zobristReady;
+
+  /*
+   * Move kernels. The direction, rank and diagonal are template
+   * arguments, so each combination compiles to its own straight-line
+   * code; generateMoves() and legalMove() look the player's direction
+   * up once and pick the kernel.
    */
-  vector<Piece> a;
-  vector<Piece> b;
-  vector<Piece> c;
-  vector<Piece> d;
-  vector<Piece> e;
-  vector<Piece> f;
-  vector<Piece> g;
-  vector<Piece> h;
-
-  map<int, Direction> playerDirections;
-};
\ No newline at end of file
+  template <Direction dir, bool king>
+  static bool steps(int from, int to, Move& m);
+  template <Direction dir>
+  uint32_t jumpers(uint32_t movers, uint32_t opponents, uint32_t empty) const;
+  template <Direction dir, bool king>
+  static void addChains(int from, int square, int first, uint32_t captured,
+    uint32_t opponents, uint32_t empty, MoveList& list, int start);
+  void addChains(int player, int from, uint32_t opponents, uint32_t empty, MoveList& list) const;
+  template <Direction dir>
+  int countMoves(uint32_t movers, uint32_t opponents, uint32_t empty) const;
+  template <Direction dir>
+  void generate(uint32_t movers, uint32_t opponents, uint32_t empty, MoveList& list) const;
+  template <Diagonal d>
+  static void addSteps(uint32_t sources, uint32_t empty, MoveList& list);
+};
+
+static_assert(is_trivially_copyable<Board>::value, "Boards are copied as plain values");
+static_assert(sizeof(Board) <= 32, "Boards are copied often, so they stay small");
@@ -0,0 +1,73 @@
+#include "Evaluation.h"
+
+#include <fstream>
+#include <sstream>
+
+int Evaluation::score(const Board& board, int player) const
+{
+  int total = pawn * board.feature(player, Board::PAWNS) +
+    king * board.feature(player, Board::KINGS) +
+    advancement * board.feature(player, Board::ADVANCEMENT) +
+    backRow * board.feature(player, Board::BACK_ROW);
+  if (mobility != 0)
+    total += mobility * board.mobility(player);
+  return total;
+}
+int Evaluation::score(const Board& board) const
+{
+  int me = board.sideToMove();
+  return score(board, me) - score(board, Board::opponent(me));
+}
+void Evaluation::score(PositionBatch& batch, vector<int>& scores) const
+{
+  batch.computeFeatures();
+  const int weights[PositionBatch::COLUMNS] = { pawn, king, advancement, backRow, mobility };
+  scores.assign(batch.size(), 0);
+  for (int c=0; c<PositionBatch::COLUMNS; c++)
+  {
+    const vector<int32_t>& first = batch.features[0][c];
+    const vector<int32_t>& second = batch.features[1][c];
+    for (size_t i=0; i<batch.size(); i++)
+      scores[i] += weights[c] * (first[i] - second[i]);
+  }
+  for (size_t i=0; i<batch.size(); i++)
+    if (batch.turns[i] == 2)
+      scores[i] = -scores[i];
+}
+
+void Evaluation::read(istream& in)
+{
+  string line;
+  while (getline(in, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+    istringstream fields(line);
+    string name;
+    int value;
+    if (!(fields >> name >> value))
+      throw "Unrecognized evaluation line";
+    if (name == "pawn") pawn = value;
+    else if (name == "king") king = value;
+    else if (name == "advancement") advancement = value;
+    else if (name == "backRow") backRow = value;
+    else if (name == "mobility") mobility = value;
+    else
+      throw "Unrecognized evaluation weight";
+  }
+}
+void Evaluation::load(const string& filename)
+{
+  ifstream in(filename);
+  if (!in)
+    throw "Unable to open evaluation file";
+  read(in);
+}
+void Evaluation::write(ostream& out) const
+{
+  out << "pawn " << pawn << endl;
+  out << "king " << king << endl;
+  out << "advancement " << advancement << endl;
+  out << "backRow " << backRow << endl;
+  out << "mobility " << mobility << endl;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+#include "PositionBatch.h"
+
+/*
+ * Evaluation scores a position statically: a weighted sum of the
+ * feature counts the Board takes from its masks (see Board::Feature)
+ * and of mobility, for the side to move less the same for its
+ * opponent. They are popcounts, not scans over the squares, so a score
+ * costs the same however many pieces are on the board.
+ *
+ * Weights can be loaded from a text file of "name value" lines, '#'
+ * comments, with names as write() prints them; names left out keep
+ * their defaults. That way tuned weights ship without a rebuild.
+ *
+ * A PositionBatch is scored all at once from its feature arrays, the
+ * same scores score(board) gives one position at a time.
+ */
+struct Evaluation
+{
+public:
+  int pawn;
+  int king;
+  int advancement; // per row a pawn has advanced
+  int backRow; // per pawn still on its home row
+  int mobility; // per legal move
+
+public:
+  Evaluation() : pawn(100), king(130), advancement(2), backRow(3), mobility(1) { }
+
+public:
+  int score(const Board& board) const;
+  int score(const Board& board, int player) const; // one player's own total
+  void score(PositionBatch& batch, vector<int>& scores) const;
+
+  void read(istream& in);
+  void load(const string& filename);
+  void write(ostream& out) const;
+};
@@ -0,0 +1,379 @@
+#include "GameRecord.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t HEADER_BYTES = 24;
+static const size_t WRITE_BUFFER_BYTES = 1 << 16;
+
+// The format is little-endian, as is every machine this builds on, so
+// fields go in and out with memcpy
+template <typename T> static T load(const uint8_t* p)
+{
+  T value;
+  memcpy(&value, p, sizeof(T));
+  return value;
+}
+
+void GameRecord::clear()
+{
+  hasStart = false;
+  start[0] = start[1] = start[2] = 0;
+  startSide = 1;
+  result = UNKNOWN;
+  moves.clear();
+  scores.clear();
+}
+
+void GameRecord::setStart(const Board& board)
+{
+  hasStart = true;
+  start[0] = board.playerMask(1);
+  start[1] = board.playerMask(2);
+  start[2] = board.kingMask();
+  startSide = board.sideToMove();
+}
+
+Board GameRecord::startBoard() const
+{
+  Board board;
+  if (hasStart)
+    board.setMasks(start[0], start[1], start[2], startSide);
+  return board;
+}
+
+GameWriter::GameWriter(const string& filename, bool index)
+  : out(filename, ios::binary | ios::trunc), index(index), closed(false), written(0)
+{
+  if (!out)
+    throw "Unable to open game archive";
+  buffer.reserve(WRITE_BUFFER_BYTES);
+
+  // Game count and index offset stay zero until close()
+  uint8_t header[HEADER_BYTES] = { 'C', 'C', 'G', 'R' };
+  memcpy(header + 4, &GAME_ARCHIVE_VERSION, 4);
+  put(header, sizeof(header));
+}
+
+GameWriter::~GameWriter()
+{
+  // Best effort: a destructor can't throw, so only close() reports
+  // a failed write
+  try
+  {
+    close();
+  }
+  catch (const char*)
+  {
+  }
+}
+
+void GameWriter::put(const void* bytes, size_t length)
+{
+  if (buffer.size() + length > WRITE_BUFFER_BYTES)
+    flush();
+  const uint8_t* b = (const uint8_t*)bytes;
+  buffer.insert(buffer.end(), b, b + length);
+  written += length;
+}
+
+void GameWriter::flush()
+{
+  out.write((const char*)buffer.data(), buffer.size());
+  buffer.clear();
+}
+
+void GameWriter::add(const GameRecord& game)
+{
+  if (closed)
+    throw "Game archive is closed";
+  if (game.moves.size() > 0xFFFF)
+    throw "Game is too long to record";
+
+  offsets.push_back(written);
+  bool scored = !game.scores.empty();
+  bool chains = false;
+  for (size_t i=0; i<game.moves.size() && !chains; i++)
+    chains = game.moves[i].jumps() > 1;
+  uint8_t head[4] = {
+    (uint8_t)((game.hasStart ? 1 : 0) | (scored ? 2 : 0) | (chains ? 4 : 0)),
+    (uint8_t)game.result
+  };
+  uint16_t plies = (uint16_t)game.moves.size();
+  memcpy(head + 2, &plies, 2);
+  put(head, 4);
+
+  if (game.hasStart)
+  {
+    uint8_t start[13];
+    memcpy(start, game.start, 12);
+    start[12] = (uint8_t)game.startSide;
+    put(start, 13);
+  }
+
+  for (size_t i=0; i<game.moves.size(); i++)
+  {
+    uint8_t squares[2] = { (uint8_t)game.moves[i].from(), (uint8_t)game.moves[i].to() };
+    put(squares, 2);
+  }
+
+  if (scored)
+  {
+    if (game.scores.size() != game.moves.size())
+      throw "Game needs one score per move";
+    for (size_t i=0; i<game.scores.size(); i++)
+    {
+      int16_t s = (int16_t)max(-32768, min(32767, game.scores[i]));
+      put(&s, 2);
+    }
+  }
+
+  if (chains)
+  {
+    for (size_t i=0; i<game.moves.size(); i++)
+      put(&game.moves[i].captures, 4);
+  }
+}
+
+void GameWriter::close()
+{
+  if (closed)
+    return;
+  closed = true;
+
+  uint64_t indexOffset = 0;
+  if (index)
+  {
+    indexOffset = written;
+    for (size_t i=0; i<offsets.size(); i++)
+      put(&offsets[i], 8);
+  }
+  flush();
+
+  uint64_t games = offsets.size();
+  out.seekp(8);
+  out.write((const char*)&games, 8);
+  out.write((const char*)&indexOffset, 8);
+  out.close();
+  if (!out)
+    throw "Unable to write game archive";
+}
+
+int GameArchive::Game::plies() const
+{
+  return load<uint16_t>(p + 2);
+}
+
+Board GameArchive::Game::startBoard() const
+{
+  Board board;
+  if (hasStart())
+    board.setMasks(load<uint32_t>(p + 4), load<uint32_t>(p + 8), load<uint32_t>(p + 12), p[16]);
+  return board;
+}
+
+Board::Move GameArchive::Game::move(int ply) const
+{
+  uint32_t c = captures(ply);
+  if (c == 0)
+    return moveBetween(from(ply), to(ply));
+
+  // A chain's first jump is whichever jump from its square takes one
+  // of its captures
+  int f = from(ply);
+  for (int d=Board::UPPER_RIGHT; d<=Board::LOWER_LEFT; d++)
+  {
+    int over = Board::JUMPED[f][d];
+    if (over != Board::NO_SQUARE && (c & (1u << over)) != 0)
+      return Board::Move::chain(f, to(ply), over, c);
+  }
+  return moveBetween(f, to(ply));
+}
+
+uint32_t GameArchive::Game::captures(int ply) const
+{
+  if (!hasCaptures())
+    return 0;
+  return load<uint32_t>(moveBytes() + 2 * plies() + (hasScores() ? 2 * plies() : 0) + 4 * ply);
+}
+
+int GameArchive::Game::score(int ply) const
+{
+  if (!hasScores())
+    return GameRecord::NO_SCORE;
+  return load<int16_t>(moveBytes() + 2 * plies() + 2 * ply);
+}
+
+void GameArchive::Game::read(GameRecord& record) const
+{
+  record.clear();
+  if (hasStart())
+    record.setStart(startBoard());
+  record.result = result();
+  int n = plies();
+  for (int i=0; i<n; i++)
+  {
+    record.moves.push_back(move(i));
+    if (hasScores())
+      record.scores.push_back(score(i));
+  }
+}
+
+Board::Move GameArchive::moveBetween(int from, int to)
+{
+  // A jump lands two steps along a diagonal, over the square one step
+  // along it
+  from &= 31;
+  to &= 31;
+  for (int d=Board::UPPER_RIGHT; d<=Board::LOWER_LEFT; d++)
+  {
+    if (Board::JUMP[from][d] == to)
+      return Board::Move(from, to, Board::JUMPED[from][d]);
+  }
+  return Board::Move(from, to);
+}
+
+GameArchive::GameArchive(const string& filename)
+  : base(nullptr), length(0), count(0), index(nullptr)
+{
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw "Unable to open game archive";
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < HEADER_BYTES)
+  {
+    ::close(fd);
+    throw "Not a game archive";
+  }
+  length = st.st_size;
+  void* mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED)
+    throw "Unable to map game archive";
+  base = (const uint8_t*)mapped;
+
+  uint32_t version = load<uint32_t>(base + 4);
+  if (memcmp(base, "CCGR", 4) != 0 || version < 1 || version > GAME_ARCHIVE_VERSION)
+  {
+    munmap(mapped, length);
+    throw "Not a game archive";
+  }
+
+  // The games end where the index starts, if there is one; the count
+  // is checked by division so that a huge one can't wrap around
+  count = load<uint64_t>(base + 8);
+  uint64_t indexOffset = load<uint64_t>(base + 16);
+  if (indexOffset != 0 && indexOffset >= HEADER_BYTES && indexOffset <= length &&
+      count <= (length - indexOffset) / 8)
+  {
+    // Trust no offset: every game must lie whole before the index
+    index = base + indexOffset;
+    for (uint64_t i=0; i<count; i++)
+    {
+      uint64_t at = load<uint64_t>(index + 8 * i);
+      if (at < HEADER_BYTES || gameBytes(at, indexOffset) == 0)
+      {
+        munmap(mapped, length);
+        throw "Not a game archive";
+      }
+    }
+    return;
+  }
+
+  // No index: walk the games, up to the index if there is one without
+  // offsets, or to the end of the file
+  uint64_t end = (indexOffset != 0 && indexOffset <= length) ? indexOffset : length;
+  uint64_t at = HEADER_BYTES;
+  for (uint64_t size; (size = gameBytes(at, end)) != 0; at += size)
+    offsets.push_back(at); // stopping at a game cut off or garbled
+  count = offsets.size();
+}
+
+uint64_t GameArchive::gameBytes(uint64_t at, uint64_t end) const
+{
+  if (at > end || end - at < 4)
+    return 0;
+  Game g;
+  g.p = base + at;
+  uint64_t size = 4 + (g.hasStart() ? 13 : 0) + 2 * g.plies() +
+    (g.hasScores() ? 2 * g.plies() : 0) + (g.hasCaptures() ? 4 * g.plies() : 0);
+  if (end - at < size)
+    return 0;
+  if (g.hasStart() && g.p[16] != 1 && g.p[16] != 2)
+    return 0;
+  const uint8_t* squares = g.moveBytes();
+  for (int i=0; i<2 * g.plies(); i++)
+  {
+    if (squares[i] >= 32)
+      return 0;
+  }
+  return size;
+}
+
+GameArchive::~GameArchive()
+{
+  munmap((void*)base, length);
+}
+
+GameArchive::Game GameArchive::game(uint64_t i) const
+{
+  if (i >= count)
+    throw "Unrecognized game request";
+  Game g;
+  g.p = base + (index != nullptr ? load<uint64_t>(index + 8 * i) : offsets[i]);
+  return g;
+}
+
+void GameArchive::readTrace(istream& in, GameRecord& record)
+{
+  record.clear();
+  Board board;
+  vector<Board::Undo> undos; // for the moves played so far, which is all of
+                            // them up to the first illegal one
+  string line;
+  while (getline(in, line))
+  {
+    if (line.compare(0, 7, "// undo") == 0)
+    {
+      if (!record.moves.empty())
+      {
+        if (undos.size() == record.moves.size())
+        {
+          board.unmakeMove(record.moves.back(), undos.back());
+          undos.pop_back();
+        }
+        record.moves.pop_back();
+      }
+      continue;
+    }
+
+    // board.move(Board::C1,Board::D2);
+    size_t first = line.find("Board::");
+    size_t second = (first == string::npos) ? first : line.find("Board::", first + 7);
+    if (line.compare(0, 11, "board.move(") != 0 || second == string::npos ||
+        first + 9 > line.size() || second + 9 > line.size())
+      continue;
+
+    Board::Coord from((char)tolower(line[first + 7]), line[first + 8] - '0');
+    Board::Coord to((char)tolower(line[second + 7]), line[second + 8] - '0');
+    int fromSquare = Board::squareOf(from);
+    int toSquare = Board::squareOf(to);
+    if (fromSquare == Board::NO_SQUARE || toSquare == Board::NO_SQUARE)
+      throw "Unrecognized trace move";
+
+    Board::Move m;
+    if (undos.size() == record.moves.size() && board.legalMove(fromSquare, toSquare, m))
+    {
+      record.moves.push_back(m);
+      undos.push_back(board.makeMove(m));
+    }
+    else
+      record.moves.push_back(moveBetween(fromSquare, toSquare));
+  }
+}
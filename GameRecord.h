@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+
+/*
+ * GameRecord is one game: where it started, its moves, optionally the
+ * score the mover expected for each, and how it ended.
+ */
+struct GameRecord
+{
+public:
+  enum Result
+  {
+    DRAW = 0, PLAYER1 = 1, PLAYER2 = 2, UNKNOWN = 3
+  };
+  static const int NO_SCORE = -32768;
+
+public:
+  bool hasStart; // otherwise the normal starting position
+  uint32_t start[3]; // player 1, player 2 and king masks
+  int startSide;
+  int result;
+  vector<Board::Move> moves;
+  vector<int> scores; // empty, or one per move (NO_SCORE where unknown)
+
+public:
+  GameRecord() { clear(); }
+
+public:
+  void clear();
+  void setStart(const Board& board);
+  Board startBoard() const;
+};
+
+/*
+ * A game archive is a file of GameRecords (all integers little-endian):
+ *
+ *   header:  "CCGR", uint32 version, uint64 games, uint64 index offset
+ *   games:   uint8 flags (1: start position, 2: scores, 4: captures),
+ *            uint8 result, uint16 plies,
+ *            [uint32 player 1, uint32 player 2, uint32 kings, uint8 side],
+ *            one (from, to) byte pair per ply, squares 0-31 as in
+ *            Board::squareOf(),
+ *            [one int16 score per ply],
+ *            [one uint32 mask of captured squares per ply]
+ *   index:   one uint64 file offset per game
+ *
+ * A move is just its two squares; the square a single jump takes is
+ * the one between them. Only a game with a capture chain of more than
+ * one jump carries the captures, since two chains can join the same
+ * squares. The game count and index are filled in by close(), so an
+ * archive whose writer never closed has neither, and readers find its
+ * games by walking the file. Version 1 archives, from before capture
+ * chains, read the same way.
+ */
+static const uint32_t GAME_ARCHIVE_VERSION = 2;
+
+/*
+ * GameWriter appends games to a new archive through its own buffer,
+ * writing to the file only when the buffer fills. close() finishes the
+ * archive and throws if it couldn't be written; the destructor closes
+ * it too if need be, but swallows the error, so call close() to see it.
+ */
+class GameWriter
+{
+public:
+  GameWriter(const string& filename, bool index = true);
+  ~GameWriter();
+
+  GameWriter(const GameWriter&) = delete;
+  GameWriter& operator=(const GameWriter&) = delete;
+
+public:
+  void add(const GameRecord& game);
+  void close();
+  uint64_t games() const { return offsets.size(); }
+
+private:
+  void put(const void* bytes, size_t length);
+  void flush();
+
+private:
+  ofstream out;
+  bool index;
+  bool closed;
+  uint64_t written; // bytes, including what is still buffered
+  vector<uint64_t> offsets;
+  vector<uint8_t> buffer;
+};
+
+/*
+ * GameArchive reads an archive in place through mmap(). Games are
+ * views into the mapping; nothing is copied until a move is asked for.
+ * Opening checks that every game lies within the file and names only
+ * squares on the board, and throws if the index points anywhere else.
+ */
+class GameArchive
+{
+public:
+  class Game
+  {
+  public:
+    int plies() const;
+    int result() const { return p[1]; }
+    bool hasStart() const { return (p[0] & 1) != 0; }
+    Board startBoard() const;
+    int from(int ply) const { return moveBytes()[2 * ply]; }
+    int to(int ply) const { return moveBytes()[2 * ply + 1]; }
+    Board::Move move(int ply) const;
+    bool hasScores() const { return (p[0] & 2) != 0; }
+    int score(int ply) const;
+    bool hasCaptures() const { return (p[0] & 4) != 0; }
+    uint32_t captures(int ply) const; // 0 if not recorded
+    void read(GameRecord& record) const;
+
+  private:
+    friend class GameArchive;
+    const uint8_t* moveBytes() const { return p + 4 + (hasStart() ? 13 : 0); }
+    const uint8_t* p;
+  };
+
+public:
+  GameArchive(const string& filename);
+  ~GameArchive();
+
+  GameArchive(const GameArchive&) = delete;
+  GameArchive& operator=(const GameArchive&) = delete;
+
+public:
+  uint64_t size() const { return count; }
+  Game game(uint64_t i) const;
+
+  static Board::Move moveBetween(int from, int to);
+
+  // Imports console trace files: one board.move(Board::C1,Board::D2);
+  // line per move, with "// undo" taking back the last one. Moves are
+  // played out from the normal start to find what each chain captured
+  static void readTrace(istream& in, GameRecord& record);
+
+private:
+  // The size of the game at file offset at, or 0 if it runs past end or
+  // has a square off the board
+  uint64_t gameBytes(uint64_t at, uint64_t end) const;
+
+private:
+  const uint8_t* base;
+  size_t length;
+  uint64_t count;
+  const uint8_t* index; // in the file, or else scanned into offsets
+  vector<uint64_t> offsets;
+};
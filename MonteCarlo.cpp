@@ -0,0 +1,395 @@
+#include "MonteCarlo.h"
+
+#include <cmath>
+
+const int MonteCarlo::SCORE_SCALE;
+const int MonteCarlo::MAX_PLAYOUT_PLIES;
+const int MonteCarlo::MAX_DEPTH;
+
+// UCT's exploration constant, for results scored 0 to 1
+static const double EXPLORATION = 1.0;
+
+MonteCarlo::MonteCarlo(int megabytes)
+  : nodes((size_t)max(megabytes, 1)), reused(0), info(nullptr), pool(nullptr),
+    stopped(false), playouts(0), deepest(0)
+{
+  clear();
+}
+
+void MonteCarlo::clear()
+{
+  Node& n = nodes[0];
+  n.move = Board::Move();
+  n.visits = 0;
+  n.points = 0;
+  n.firstChild = 0;
+  n.children = 0;
+  n.state = UNEXPANDED;
+  nodes.reset(1);
+  reused = 0;
+}
+
+bool MonteCarlo::samePosition(const Board& lhs, const Board& rhs)
+{
+  return lhs.playerMask(1) == rhs.playerMask(1) && lhs.playerMask(2) == rhs.playerMask(2) &&
+    lhs.kingMask() == rhs.kingMask() && lhs.sideToMove() == rhs.sideToMove();
+}
+
+int MonteCarlo::elapsed() const
+{
+  return (int)chrono::duration_cast<chrono::milliseconds>(
+    chrono::steady_clock::now() - start).count();
+}
+
+SearchResult MonteCarlo::run(const Board& board, const SearchLimits& l, const PositionHistory& game)
+{
+  limits = l;
+  rootHistory = game;
+  stopped = false;
+  playouts = 0;
+  deepest = 0;
+  start = chrono::steady_clock::now();
+  arena.reset();
+  reuse(board);
+
+  SearchResult result;
+  Board::MoveList rootMoves;
+  root.generateMoves(root.sideToMove(), rootMoves);
+  if (rootMoves.empty())
+  {
+    result.score = -SCORE_SCALE;
+    return result;
+  }
+
+  // A forced move needs no thought
+  if (rootMoves.size() > 1)
+  {
+    ThreadPool::TaskGroup group;
+    if (pool != nullptr && limits.threads > 1)
+    {
+      for (int i=1; i<limits.threads; i++)
+      {
+        uint64_t seed = seeds();
+        pool->submit(group, [this, seed]() { work(seed); });
+      }
+    }
+    work(seeds());
+    stopped = true;
+    if (pool != nullptr && limits.threads > 1)
+      pool->wait(group);
+  }
+
+  result.hasMove = true;
+  result.bestMove = rootMoves[0];
+  const Node* n = &nodes[0];
+  if (n->state == EXPANDED && n->children > 0)
+  {
+    uint32_t best = mostVisited(*n);
+    const Node& b = nodes[best];
+    uint32_t visits = b.visits;
+    result.bestMove = b.move;
+    if (visits > 0)
+      result.score = (int)((int64_t)b.points * SCORE_SCALE / visits) - SCORE_SCALE;
+  }
+  while (n->state == EXPANDED && n->children > 0 && (int)result.pv.size() < MAX_DEPTH)
+  {
+    n = &nodes[mostVisited(*n)];
+    if (n->visits == 0)
+      break;
+    result.pv.push_back(n->move);
+  }
+  if (result.pv.empty())
+    result.pv.push_back(result.bestMove);
+  result.depth = deepest;
+  result.nodes = playouts;
+  result.memory = nodes.bytesUsed() + arena.bytesUsed();
+  result.milliseconds = elapsed();
+  report(result);
+  return result;
+}
+
+void MonteCarlo::reuse(const Board& board)
+{
+  // Look for the position at the root, a child or a grandchild
+  uint32_t found = UINT32_MAX;
+  const Node& top = nodes[0];
+  if (samePosition(root, board))
+    found = 0;
+  else if (top.state == EXPANDED)
+  {
+    for (uint32_t i=0; i<top.children && found == UINT32_MAX; i++)
+    {
+      const Node& child = nodes[top.firstChild + i];
+      Board next = root;
+      next.makeMove(child.move);
+      if (samePosition(next, board))
+        found = top.firstChild + i;
+      else if (child.state == EXPANDED)
+      {
+        for (uint32_t j=0; j<child.children; j++)
+        {
+          Board after = next;
+          after.makeMove(nodes[child.firstChild + j].move);
+          if (samePosition(after, board))
+          {
+            found = child.firstChild + j;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  root = board;
+  if (found == UINT32_MAX)
+    clear();
+  else
+  {
+    if (found != 0)
+      keepSubtree(found);
+    reused = treeNodes();
+  }
+}
+
+void MonteCarlo::keepSubtree(uint32_t index)
+{
+  struct Saved
+  {
+  public:
+    Board::Move move;
+    uint32_t visits;
+    uint32_t points;
+    uint32_t firstChild;
+    uint16_t children;
+    uint8_t state;
+  };
+
+  // Breadth first, so that each node's children stay side by side and
+  // old indices map to new ones in order. The subtree is no bigger than
+  // the tree, which bounds the scratch
+  uint32_t* order = arena.allocate<uint32_t>(nodes.size());
+  Saved* saved = arena.allocate<Saved>(nodes.size());
+  uint32_t count = 1;
+  order[0] = index;
+  for (uint32_t i=0; i<count; i++)
+  {
+    const Node& n = nodes[order[i]];
+    Saved& s = saved[i];
+    s.move = n.move;
+    s.visits = n.visits;
+    s.points = n.points;
+    s.firstChild = 0;
+    s.children = 0;
+    s.state = n.state == EXPANDED ? EXPANDED : UNEXPANDED;
+    if (s.state == EXPANDED)
+    {
+      s.firstChild = count;
+      s.children = n.children;
+      for (uint32_t c=0; c<n.children; c++)
+        order[count++] = n.firstChild + c;
+    }
+  }
+
+  for (uint32_t i=0; i<count; i++)
+  {
+    Node& n = nodes[i];
+    n.move = saved[i].move;
+    n.visits = saved[i].visits;
+    n.points = saved[i].points;
+    n.firstChild = saved[i].firstChild;
+    n.children = saved[i].children;
+    n.state = saved[i].state;
+  }
+  nodes.reset(count);
+}
+
+bool MonteCarlo::outOfBudget(uint64_t done)
+{
+  if (stopped)
+    return true;
+  if (limits.nodes != 0 && playouts.load(memory_order_relaxed) >= limits.nodes)
+    stopped = true;
+  // Reading the clock costs more than a short playout
+  else if (limits.milliseconds != 0 && (done & 15) == 0 && elapsed() >= limits.milliseconds)
+    stopped = true;
+  return stopped;
+}
+
+void MonteCarlo::work(uint64_t seed)
+{
+  mt19937_64 random(seed);
+  // Each thread's own copy, cut back to the root's after each playout
+  PositionHistory history = rootHistory;
+  history.reserve(rootHistory.size() + MAX_DEPTH + MAX_PLAYOUT_PLIES);
+  for (uint64_t done=0; !outOfBudget(done); done++)
+  {
+    iterate(random, history);
+    playouts.fetch_add(1, memory_order_relaxed);
+  }
+}
+
+void MonteCarlo::iterate(mt19937_64& random, PositionHistory& history)
+{
+  Board board = root;
+  history.truncate(rootHistory.size());
+  uint32_t path[MAX_DEPTH + 1];
+  int length = 0;
+  uint32_t index = 0;
+  nodes[0].visits.fetch_add(1, memory_order_relaxed);
+  path[length++] = 0;
+
+  while (length <= MAX_DEPTH)
+  {
+    Node& n = nodes[index];
+    uint8_t state = n.state.load(memory_order_acquire);
+    if (state == UNEXPANDED)
+    {
+      uint8_t expected = UNEXPANDED;
+      if (n.state.compare_exchange_strong(expected, EXPANDING, memory_order_acquire) &&
+          expand(index, board, history))
+        state = EXPANDED;
+    }
+    if (state != EXPANDED || n.children == 0)
+      break;
+
+    index = select(n);
+    Node& child = nodes[index];
+    history.push(board);
+    board.makeMove(child.move);
+    uint32_t before = child.visits.fetch_add(1, memory_order_relaxed); // the virtual loss
+    path[length++] = index;
+    if (before == 0)
+      break;
+  }
+
+  int depth = length - 1;
+  int seen = deepest.load(memory_order_relaxed);
+  while (depth > seen && !deepest.compare_exchange_weak(seen, depth, memory_order_relaxed)) { }
+
+  // The visits are already counted; a win or draw takes back the loss
+  int winner = playOut(board, history, random);
+  int mover = Board::opponent(root.sideToMove());
+  for (int i=0; i<length; i++)
+  {
+    if (winner == mover)
+      nodes[path[i]].points.fetch_add(2, memory_order_relaxed);
+    else if (winner == 0)
+      nodes[path[i]].points.fetch_add(1, memory_order_relaxed);
+    mover = Board::opponent(mover);
+  }
+}
+
+bool MonteCarlo::expand(uint32_t index, const Board& board, const PositionHistory& history)
+{
+  Node& n = nodes[index];
+  Board::MoveList list;
+  board.generateMoves(board.sideToMove(), list);
+  if (list.empty() || history.isDraw(board))
+    list.clear();
+
+  uint32_t first = nodes.allocate((uint32_t)list.size());
+  if (first == NodePool<Node>::NONE)
+  {
+    // Full: leave it a leaf
+    n.state.store(UNEXPANDED, memory_order_release);
+    return false;
+  }
+  for (int i=0; i<list.size(); i++)
+  {
+    Node& child = nodes[first + i];
+    child.move = list[i];
+    child.visits.store(0, memory_order_relaxed);
+    child.points.store(0, memory_order_relaxed);
+    child.firstChild = 0;
+    child.children = 0;
+    child.state.store(UNEXPANDED, memory_order_relaxed);
+  }
+  n.firstChild = first;
+  n.children = (uint16_t)list.size();
+  n.state.store(EXPANDED, memory_order_release);
+  return true;
+}
+
+uint32_t MonteCarlo::select(const Node& node) const
+{
+  double logVisits = log((double)max(node.visits.load(memory_order_relaxed), 1u));
+  uint32_t best = node.firstChild;
+  double bestValue = -1;
+  for (uint32_t i=0; i<node.children; i++)
+  {
+    const Node& child = nodes[node.firstChild + i];
+    uint32_t visits = child.visits.load(memory_order_relaxed);
+    if (visits == 0)
+      return node.firstChild + i;
+    double value = child.points.load(memory_order_relaxed) / (2.0 * visits) +
+      EXPLORATION * sqrt(logVisits / visits);
+    if (value > bestValue)
+    {
+      bestValue = value;
+      best = node.firstChild + i;
+    }
+  }
+  return best;
+}
+
+int MonteCarlo::playOut(Board& board, PositionHistory& history, mt19937_64& random) const
+{
+  Board::MoveList list;
+  for (int ply=0; ply<MAX_PLAYOUT_PLIES; ply++)
+  {
+    board.generateMoves(board.sideToMove(), list);
+    if (list.empty())
+      return Board::opponent(board.sideToMove());
+    if (history.isDraw(board))
+      return 0;
+
+    // Moves are all captures or all steps; of captures, take one of the
+    // longest chains
+    int choice = (int)(random() % (uint64_t)list.size());
+    if (list[0].isJump())
+    {
+      int most = 0;
+      int ties = 0;
+      for (int i=0; i<list.size(); i++)
+      {
+        int jumps = list[i].jumps();
+        if (jumps > most)
+        {
+          most = jumps;
+          ties = 0;
+        }
+        if (jumps == most && random() % (uint64_t)++ties == 0)
+          choice = i;
+      }
+    }
+    history.push(board);
+    board.makeMove(list[choice]);
+  }
+  return 0;
+}
+
+uint32_t MonteCarlo::mostVisited(const Node& node) const
+{
+  uint32_t best = node.firstChild;
+  for (uint32_t i=1; i<node.children; i++)
+  {
+    if (nodes[node.firstChild + i].visits > nodes[best].visits)
+      best = node.firstChild + i;
+  }
+  return best;
+}
+
+void MonteCarlo::report(const SearchResult& result) const
+{
+  if (info == nullptr)
+    return;
+
+  uint64_t pps = result.nodes * 1000 / (uint64_t)(result.milliseconds > 0 ? result.milliseconds : 1);
+  (*info) << "info depth " << result.depth << " score " << result.score
+    << " playouts " << result.nodes << " time " << result.milliseconds << " pps " << pps
+    << " tree " << treeNodes() << " reused " << reused << " memory " << result.memory / 1024
+    << "k pv";
+  for (size_t i=0; i<result.pv.size(); i++)
+    (*info) << " " << Board::moveName(result.pv[i]);
+  (*info) << endl;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+using namespace std;
+
+#include "Arena.h"
+#include "Board.h"
+#include "PositionHistory.h"
+#include "Search.h"
+#include "ThreadPool.h"
+
+/*
+ * MonteCarlo is the other engine: UCT tree search, which scores moves
+ * by playing games out at random rather than with an Evaluation. Each
+ * playout walks down the tree taking the child with the best upper
+ * confidence bound, adds the children of the leaf it reaches, and plays
+ * on from there with makeMove() to the end of the game, at random but
+ * taking the longest capture chain when it has a choice of captures.
+ * The result, a win, draw or loss, is added to every node on the way.
+ *
+ * With a ThreadPool and limits.threads > 1 that many threads walk the
+ * same tree. A thread counts its visit to each node as it goes down,
+ * before its result is known, so until then the visit counts as a loss
+ * (a virtual loss) and steers the other threads onto other lines. The
+ * counts are atomics, and a leaf is expanded by whichever thread claims
+ * it first; the others play out from it meanwhile.
+ *
+ * Nodes live in a NodePool, with a node's children side by side in it
+ * and found by a 32-bit index. When the pool is full the tree stops
+ * growing, and playouts go on from its leaves.
+ *
+ * run() keeps the tree for the next run: if the new position is the
+ * root's, or one or two plies below it in the tree (our move and the
+ * reply), that subtree is copied to the front of the pool as the new
+ * tree, by way of scratch space in an Arena, and the rest is dropped.
+ * The Arena is the engine's own and each run() resets it, so its
+ * blocks are allocated once and reused move after move.
+ *
+ * The game's positions before the root, if run() is given them, count
+ * towards repetitions, in the tree and in playouts alike.
+ *
+ * limits.nodes counts playouts, and limits.depth is not used. In the
+ * result, bestMove is the most visited move and pv the most visited
+ * line, score is bestMove's win rate mapped onto -SCORE_SCALE to
+ * SCORE_SCALE, depth is the deepest the tree reached, nodes counts
+ * playouts and memory is the tree's size plus the scratch this run used.
+ */
+class MonteCarlo
+{
+public:
+  static const int SCORE_SCALE = 1000;
+  static const int MAX_PLAYOUT_PLIES = 300; // then it's a draw
+  static const int MAX_DEPTH = 128; // tree plies a playout walks
+
+public:
+  MonteCarlo(int megabytes);
+
+  MonteCarlo(const MonteCarlo&) = delete;
+  MonteCarlo& operator=(const MonteCarlo&) = delete;
+
+public:
+  SearchResult run(const Board& board, const SearchLimits& limits,
+    const PositionHistory& game = PositionHistory());
+  void clear(); // forget the tree
+
+  void setInfo(ostream* out) { info = out; }
+  void setPool(ThreadPool* p) { pool = p; }
+  void setSeed(uint64_t seed) { seeds.seed(seed); }
+  void stop() { stopped = true; }
+
+  uint32_t treeNodes() const { return nodes.size(); }
+  uint32_t reusedNodes() const { return reused; } // at the start of the last run
+  uint32_t capacity() const { return nodes.capacity(); }
+
+private:
+  enum State : uint8_t
+  {
+    UNEXPANDED, EXPANDING, EXPANDED
+  };
+
+  struct Node
+  {
+  public:
+    Board::Move move; // the one that led here
+    atomic<uint32_t> visits;
+    atomic<uint32_t> points; // 2 a win and 1 a draw, for the side that played move
+    uint32_t firstChild;
+    uint16_t children;
+    atomic<uint8_t> state;
+  };
+
+  void reuse(const Board& board);
+  void keepSubtree(uint32_t index);
+  void work(uint64_t seed);
+  void iterate(mt19937_64& random, PositionHistory& history);
+  bool expand(uint32_t index, const Board& board, const PositionHistory& history);
+  uint32_t select(const Node& node) const;
+  int playOut(Board& board, PositionHistory& history, mt19937_64& random) const;
+  uint32_t mostVisited(const Node& node) const;
+  bool outOfBudget(uint64_t done);
+  int elapsed() const;
+  void report(const SearchResult& result) const;
+
+  static bool samePosition(const Board& lhs, const Board& rhs);
+
+private:
+  NodePool<Node> nodes;
+  uint32_t reused;
+  Arena arena; // scratch for one run
+
+  ostream* info;
+  ThreadPool* pool;
+  mt19937_64 seeds;
+  Board root;
+  PositionHistory rootHistory;
+  SearchLimits limits;
+  atomic<bool> stopped;
+  atomic<uint64_t> playouts;
+  atomic<int> deepest;
+  chrono::steady_clock::time_point start;
+};
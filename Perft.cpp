@@ -0,0 +1,129 @@
+#include "Perft.h"
+
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
+// Below this depth a subtree is too small to be worth a task
+static const int MIN_SPLIT_DEPTH = 4;
+
+static void countInParallel(const Board& board, int depth, ThreadPool& pool,
+  int splitPlies, atomic<uint64_t>& total)
+{
+  if (splitPlies <= 0 || depth < MIN_SPLIT_DEPTH)
+  {
+    Board scratch = board;
+    total.fetch_add(Perft::count(scratch, depth), memory_order_relaxed);
+    return;
+  }
+
+  Board::MoveList list;
+  board.generateMoves(board.sideToMove(), list);
+  ThreadPool::TaskGroup group;
+  for (int i=0; i<list.size(); i++)
+  {
+    Board child = board;
+    child.makeMove(list[i]);
+    pool.submit(group, [child, depth, splitPlies, &pool, &total]() {
+      countInParallel(child, depth - 1, pool, splitPlies - 1, total);
+    });
+  }
+  pool.wait(group);
+}
+
+uint64_t Perft::count(Board& board, int depth)
+{
+  Board::MoveList list;
+  board.generateMoves(board.sideToMove(), list);
+  if (depth <= 1)
+    return depth == 1 ? list.size() : 1;
+
+  uint64_t nodes = 0;
+  for (int i=0; i<list.size(); i++)
+  {
+    Board::Undo undo = board.makeMove(list[i]);
+    nodes += count(board, depth - 1);
+    board.unmakeMove(list[i], undo);
+  }
+  return nodes;
+}
+
+uint64_t Perft::divide(Board& board, int depth, ostream& out)
+{
+  Board::MoveList list;
+  board.generateMoves(board.sideToMove(), list);
+
+  uint64_t nodes = 0;
+  for (int i=0; i<list.size(); i++)
+  {
+    Board::Undo undo = board.makeMove(list[i]);
+    uint64_t n = count(board, depth - 1);
+    board.unmakeMove(list[i], undo);
+
+    out << Board::moveName(list[i]) << " " << n << endl;
+    nodes += n;
+  }
+  return nodes;
+}
+
+uint64_t Perft::count(const Board& board, int depth, ThreadPool& pool, int splitPlies)
+{
+  if (depth <= 1)
+  {
+    Board scratch = board;
+    return count(scratch, depth);
+  }
+  atomic<uint64_t> total(0);
+  countInParallel(board, depth, pool, splitPlies, total);
+  return total.load();
+}
+
+uint64_t Perft::divide(const Board& board, int depth, ThreadPool& pool,
+  ostream& out, int splitPlies)
+{
+  Board::MoveList list;
+  board.generateMoves(board.sideToMove(), list);
+
+  vector<atomic<uint64_t> > counts(list.size());
+  ThreadPool::TaskGroup group;
+  for (int i=0; i<list.size(); i++)
+  {
+    counts[i] = 0;
+    Board child = board;
+    child.makeMove(list[i]);
+    atomic<uint64_t>* slot = &counts[i];
+    pool.submit(group, [child, depth, splitPlies, &pool, slot]() {
+      countInParallel(child, depth - 1, pool, splitPlies - 1, *slot);
+    });
+  }
+  pool.wait(group);
+
+  uint64_t nodes = 0;
+  for (int i=0; i<list.size(); i++)
+  {
+    out << Board::moveName(list[i]) << " " << counts[i] << endl;
+    nodes += counts[i];
+  }
+  return nodes;
+}
+
+vector<Perft::Count> Perft::load(const string& filename)
+{
+  ifstream in(filename);
+  if (!in)
+    throw "Unable to open perft file";
+
+  vector<Count> counts;
+  string line;
+  while (getline(in, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+    istringstream fields(line);
+    Count c;
+    if (!(fields >> c.position >> c.depth >> c.nodes))
+      throw "Unrecognized perft line";
+    counts.push_back(c);
+  }
+  return counts;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+#include "ThreadPool.h"
+
+/*
+ * Perft counts the leaf nodes of the full move tree to a fixed depth,
+ * playing every move the generator offers for the side to move. The
+ * counts pin down the rules (column wrap, jumps, promotion), so any
+ * change that alters them has changed the game.
+ *
+ * The parallel versions hand each move at the first splitPlies plies
+ * to the pool as a task with its own copy of the Board.
+ */
+class Perft
+{
+public:
+  struct Count
+  {
+  public:
+    string position;
+    int depth;
+    uint64_t nodes;
+  };
+
+public:
+  static uint64_t count(Board& board, int depth);
+  static uint64_t divide(Board& board, int depth, ostream& out);
+  static uint64_t count(const Board& board, int depth, ThreadPool& pool, int splitPlies = 2);
+  static uint64_t divide(const Board& board, int depth, ThreadPool& pool, ostream& out, int splitPlies = 2);
+
+  // Stored counts: one "position depth nodes" per line, '#' comments
+  static vector<Count> load(const string& filename);
+};
@@ -0,0 +1,68 @@
+#include "Ponder.h"
+
+Ponder::Ponder(Search& search)
+  : search(search), cancelled(false), done(false)
+{
+  search.setStopSignal(&cancelled);
+}
+
+Ponder::~Ponder()
+{
+  cancel();
+  search.setStopSignal(nullptr);
+}
+
+void Ponder::start(const Board& board, const PositionHistory& game, const Board::Move& predicted)
+{
+  cancel();
+  Board next = board;
+  PositionHistory history = game;
+  history.push(board);
+  next.makeMove(predicted);
+
+  prediction = predicted;
+  started = chrono::steady_clock::now();
+  cancelled = false;
+  done = false;
+  worker = thread([this, next, history]() {
+    SearchResult r = search.run(next, SearchLimits(), history);
+    lock_guard<mutex> guard(lock);
+    result = r;
+    done = true;
+    finished.notify_all();
+  });
+}
+
+bool Ponder::finish(const Board::Move& played, int milliseconds, SearchResult& out)
+{
+  if (!active())
+    return false;
+  if (!(played == prediction))
+  {
+    cancel();
+    return false;
+  }
+
+  // The search usually runs until it is stopped, but a forced result
+  // can end it sooner
+  {
+    unique_lock<mutex> guard(lock);
+    finished.wait_until(guard, started + chrono::milliseconds(milliseconds),
+      [this]() { return done; });
+  }
+  stopAndJoin();
+  out = result;
+  return out.hasMove;
+}
+
+void Ponder::cancel()
+{
+  if (active())
+    stopAndJoin();
+}
+
+void Ponder::stopAndJoin()
+{
+  cancelled = true;
+  worker.join();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+using namespace std;
+
+#include "Board.h"
+#include "Search.h"
+
+/*
+ * Ponder searches on a thread of its own while the opponent thinks.
+ * start() plays the move we expect from them on a copy of the position
+ * and searches our answer to it with no limit; finish() is told the
+ * move they really played. If it is the predicted one the search is
+ * kept, and runs on until the move's time budget is spent, counting
+ * from start(), so time the opponent took is time we don't; if not,
+ * the search is cancelled and finish() returns without a result.
+ *
+ * Cancelling goes through the Search's stop signal, so it takes effect
+ * at its next node check even if the thread hasn't begun searching.
+ * The Search is Ponder's while it is active, so don't run it elsewhere;
+ * and leave its info stream unset, or its reports land in the middle
+ * of the opponent's typing.
+ */
+class Ponder
+{
+public:
+  Ponder(Search& search);
+  ~Ponder();
+
+  Ponder(const Ponder&) = delete;
+  Ponder& operator=(const Ponder&) = delete;
+
+public:
+  void start(const Board& board, const PositionHistory& game, const Board::Move& predicted);
+  bool finish(const Board::Move& played, int milliseconds, SearchResult& result);
+  void cancel();
+
+  bool active() const { return worker.joinable(); }
+  Board::Move predicted() const { return prediction; }
+
+private:
+  void stopAndJoin();
+
+private:
+  Search& search;
+  thread worker;
+  atomic<bool> cancelled;
+  Board::Move prediction;
+  chrono::steady_clock::time_point started;
+
+  mutex lock;
+  condition_variable finished;
+  bool done; // the search returned on its own
+  SearchResult result;
+};
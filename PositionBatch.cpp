@@ -0,0 +1,208 @@
+#include "PositionBatch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POSITION_BATCH_AVX2
+#include <immintrin.h>
+#endif
+
+// Rows a-h are squares 0-31 four at a time, so a pawn's rows advanced
+// add up from these bits of its row number
+static const uint32_t ROW_BIT_0 = 0xF0F0F0F0u;
+static const uint32_t ROW_BIT_1 = 0xFF00FF00u;
+static const uint32_t ROW_BIT_2 = 0xFFFF0000u;
+static const uint32_t HOME_ROW[2] = { 0x0000000Fu, 0xF0000000u };
+
+void PositionBatch::add(const Board& board)
+{
+  if (board.getPlayerDirection(1) != Board::Direction::A_TO_H ||
+      board.getPlayerDirection(2) != Board::Direction::H_TO_A ||
+      board.playerMask(0) != 0 ||
+      (board.sideToMove() != 1 && board.sideToMove() != 2))
+    throw "Position batches hold only the normal game";
+  player1.push_back(board.playerMask(1));
+  player2.push_back(board.playerMask(2));
+  kings.push_back(board.kingMask());
+  turns.push_back((uint8_t)board.sideToMove());
+}
+void PositionBatch::clear()
+{
+  player1.clear();
+  player2.clear();
+  kings.clear();
+  turns.clear();
+  for (int p=0; p<2; p++)
+    for (int c=0; c<COLUMNS; c++)
+      features[p][c].clear();
+}
+Board PositionBatch::board(size_t i) const
+{
+  Board b;
+  b.setMasks(player1[i], player2[i], kings[i], turns[i]);
+  return b;
+}
+
+void PositionBatch::computeFeatures()
+{
+  if (hasAvx2())
+    computeFeaturesAvx2();
+  else
+    computeFeaturesScalar();
+}
+void PositionBatch::computeFeaturesScalar()
+{
+  resizeFeatures();
+  computeScalar(0);
+}
+void PositionBatch::resizeFeatures()
+{
+  for (int p=0; p<2; p++)
+    for (int c=0; c<COLUMNS; c++)
+      features[p][c].resize(size());
+}
+void PositionBatch::computeScalar(size_t from)
+{
+  for (size_t i=from; i<size(); i++)
+  {
+    uint32_t own[2] = { player1[i], player2[i] };
+    uint32_t empty = ~(own[0] | own[1]);
+    for (int p=0; p<2; p++)
+    {
+      uint32_t pawns = own[p] & ~kings[i];
+      int pawnCount = __builtin_popcount(pawns);
+      int rows = __builtin_popcount(pawns & ROW_BIT_0) + 2 * __builtin_popcount(pawns & ROW_BIT_1) +
+        4 * __builtin_popcount(pawns & ROW_BIT_2);
+      features[p][Board::PAWNS][i] = pawnCount;
+      features[p][Board::KINGS][i] = __builtin_popcount(own[p] & kings[i]);
+      features[p][Board::ADVANCEMENT][i] = (p == 0) ? rows : 7 * pawnCount - rows;
+      features[p][Board::BACK_ROW][i] = __builtin_popcount(pawns & HOME_ROW[p]);
+
+      // As Board::countMoves(): first jumps if there are any, else steps
+      uint32_t opponents = own[1 - p];
+      uint32_t upper = (p == 1) ? own[p] : own[p] & kings[i];
+      uint32_t lower = (p == 0) ? own[p] : own[p] & kings[i];
+      uint32_t movers[4] = { upper, upper, lower, lower };
+      int jumps = 0, steps = 0;
+      for (int d=0; d<4; d++)
+      {
+        Board::Diagonal diagonal = (Board::Diagonal)d;
+        uint32_t stepped = Board::shift(diagonal, movers[d]);
+        jumps += __builtin_popcount(Board::shift(diagonal, stepped & opponents) & empty);
+        steps += __builtin_popcount(stepped & empty);
+      }
+      features[p][MOBILITY][i] = jumps ? jumps : steps;
+    }
+  }
+}
+
+#ifdef POSITION_BATCH_AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static __m256i splat(uint32_t m)
+{
+  return _mm256_set1_epi32((int)m);
+}
+AVX2 static __m256i popcounts(__m256i m)
+{
+  // Per byte from a nibble table, then the four bytes of each lane summed
+  const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  __m256i bytes = _mm256_add_epi8(
+    _mm256_shuffle_epi8(table, _mm256_and_si256(m, nibble)),
+    _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(m, 4), nibble)));
+  return _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, _mm256_set1_epi8(1)), _mm256_set1_epi16(1));
+}
+AVX2 static __m256i rotateRowsLeft(__m256i m)
+{
+  return _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(m, 1), splat(0xEEEEEEEEu)),
+    _mm256_and_si256(_mm256_srli_epi32(m, 3), splat(0x11111111u)));
+}
+AVX2 static __m256i rotateRowsRight(__m256i m)
+{
+  return _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(m, 1), splat(0x77777777u)),
+    _mm256_and_si256(_mm256_slli_epi32(m, 3), splat(0x88888888u)));
+}
+AVX2 static __m256i shift(Board::Diagonal d, __m256i m)
+{
+  // Board::shift(), lane by lane
+  __m256i even = _mm256_and_si256(m, splat(Board::EVEN_ROWS));
+  __m256i odd = _mm256_and_si256(m, splat(Board::ODD_ROWS));
+  switch (d)
+  {
+    case Board::UPPER_RIGHT:
+      return _mm256_or_si256(_mm256_srli_epi32(even, 4), rotateRowsLeft(_mm256_srli_epi32(odd, 4)));
+    case Board::UPPER_LEFT:
+      return _mm256_or_si256(rotateRowsRight(_mm256_srli_epi32(even, 4)), _mm256_srli_epi32(odd, 4));
+    case Board::LOWER_RIGHT:
+      return _mm256_or_si256(_mm256_slli_epi32(even, 4), rotateRowsLeft(_mm256_slli_epi32(odd, 4)));
+    default:
+      return _mm256_or_si256(rotateRowsRight(_mm256_slli_epi32(even, 4)), _mm256_slli_epi32(odd, 4));
+  }
+}
+AVX2 static void store(vector<int32_t>& column, size_t i, __m256i values)
+{
+  _mm256_storeu_si256((__m256i*)&column[i], values);
+}
+
+AVX2 void PositionBatch::computeFeaturesAvx2()
+{
+  resizeFeatures();
+  size_t whole = size() & ~(size_t)7;
+  for (size_t i=0; i<whole; i+=8)
+  {
+    __m256i own[2] = {
+      _mm256_loadu_si256((const __m256i*)&player1[i]),
+      _mm256_loadu_si256((const __m256i*)&player2[i])
+    };
+    __m256i king = _mm256_loadu_si256((const __m256i*)&kings[i]);
+    __m256i empty = _mm256_xor_si256(_mm256_or_si256(own[0], own[1]), _mm256_set1_epi32(-1));
+    for (int p=0; p<2; p++)
+    {
+      __m256i pawns = _mm256_andnot_si256(king, own[p]);
+      __m256i pawnCount = popcounts(pawns);
+      __m256i rows = _mm256_add_epi32(popcounts(_mm256_and_si256(pawns, splat(ROW_BIT_0))),
+        _mm256_add_epi32(_mm256_slli_epi32(popcounts(_mm256_and_si256(pawns, splat(ROW_BIT_1))), 1),
+          _mm256_slli_epi32(popcounts(_mm256_and_si256(pawns, splat(ROW_BIT_2))), 2)));
+      store(features[p][Board::PAWNS], i, pawnCount);
+      store(features[p][Board::KINGS], i, popcounts(_mm256_and_si256(own[p], king)));
+      store(features[p][Board::ADVANCEMENT], i, (p == 0) ? rows :
+        _mm256_sub_epi32(_mm256_sub_epi32(_mm256_slli_epi32(pawnCount, 3), pawnCount), rows));
+      store(features[p][Board::BACK_ROW], i, popcounts(_mm256_and_si256(pawns, splat(HOME_ROW[p]))));
+
+      __m256i opponents = own[1 - p];
+      __m256i upper = (p == 1) ? own[p] : _mm256_and_si256(own[p], king);
+      __m256i lower = (p == 0) ? own[p] : _mm256_and_si256(own[p], king);
+      __m256i movers[4] = { upper, upper, lower, lower };
+      __m256i jumps = _mm256_setzero_si256(), steps = _mm256_setzero_si256();
+      for (int d=0; d<4; d++)
+      {
+        Board::Diagonal diagonal = (Board::Diagonal)d;
+        __m256i stepped = shift(diagonal, movers[d]);
+        jumps = _mm256_add_epi32(jumps, popcounts(_mm256_and_si256(
+          shift(diagonal, _mm256_and_si256(stepped, opponents)), empty)));
+        steps = _mm256_add_epi32(steps, popcounts(_mm256_and_si256(stepped, empty)));
+      }
+      __m256i noJumps = _mm256_cmpeq_epi32(jumps, _mm256_setzero_si256());
+      store(features[p][MOBILITY], i, _mm256_add_epi32(jumps, _mm256_and_si256(steps, noJumps)));
+    }
+  }
+  computeScalar(whole);
+}
+bool PositionBatch::hasAvx2()
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+void PositionBatch::computeFeaturesAvx2()
+{
+  throw "AVX2 is not available";
+}
+bool PositionBatch::hasAvx2()
+{
+  return false;
+}
+
+#endif
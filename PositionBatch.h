@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+
+/*
+ * PositionBatch holds many positions of the normal game (player 1
+ * moving A_TO_H, player 2 H_TO_A) as structure of arrays: one array per
+ * mask and one of sides to move, position i at index i of each. That
+ * way a whole batch, such as every position of a game archive, can be
+ * scored without building a Board per position.
+ *
+ * computeFeatures() fills the feature arrays for every position: the
+ * Board::Feature counts and mobility, per player, exactly as a Board
+ * holding the position would report them. Every rule it needs is a
+ * mask operation (Board::shift() for the diagonals, the row nibble
+ * rotation for the column wrap) and popcounts, so the same steps run on
+ * eight positions at once in AVX2 registers, lane by lane. Whether the
+ * CPU has AVX2 is checked when the program runs; without it, or on
+ * other architectures, the scalar version does the work.
+ */
+class PositionBatch
+{
+public:
+  static const int MOBILITY = Board::FEATURES; // after the Board::Feature columns
+  static const int COLUMNS = Board::FEATURES + 1;
+
+public:
+  vector<uint32_t> player1;
+  vector<uint32_t> player2;
+  vector<uint32_t> kings;
+  vector<uint8_t> turns;
+
+  // features[player - 1][column][i], once computeFeatures() has run
+  vector<int32_t> features[2][COLUMNS];
+
+public:
+  size_t size() const { return turns.size(); }
+  void add(const Board& board);
+  void clear();
+  Board board(size_t i) const;
+
+  void computeFeatures();
+  void computeFeaturesScalar();
+  void computeFeaturesAvx2(); // only where hasAvx2()
+
+  static bool hasAvx2();
+
+private:
+  void resizeFeatures();
+  void computeScalar(size_t from);
+};
@@ -0,0 +1,16 @@
+#include "PositionHistory.h"
+
+#include <algorithm>
+
+int PositionHistory::repetitions(const Board& board) const
+{
+  int back = min(board.getQuietPlies(), (int)keys.size());
+  uint32_t key = board.exactKey();
+  int count = 0;
+  for (int i=2; i<=back; i+=2)
+  {
+    if (keys[keys.size() - i] == key)
+      count++;
+  }
+  return count;
+}
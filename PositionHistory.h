@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+
+/*
+ * PositionHistory is the stack of positions a game or a search has
+ * passed through, one Board::exactKey() per ply, for telling when a
+ * position comes up for the third time. It lives beside the Board
+ * rather than in it, so that a Board stays a small value that is cheap
+ * to copy: a game keeps one history, and a search pushes a key for
+ * each ply it goes down and pops it on the way back.
+ *
+ * push() takes the position a move is about to be made from. Nothing
+ * before the last capture or pawn move can come up again, and the
+ * Board counts those plies, so repetitions() looks back no further
+ * than Board::getQuietPlies(), and only at every other ply, where the
+ * same side was to move.
+ */
+class PositionHistory
+{
+public:
+  void push(const Board& board) { keys.push_back(board.exactKey()); }
+  void pop() { keys.pop_back(); }
+  void clear() { keys.clear(); }
+  void reserve(size_t plies) { keys.reserve(plies); }
+  void truncate(size_t plies) { keys.resize(plies); } // back to an earlier size()
+  size_t size() const { return keys.size(); }
+
+  // Earlier occurrences of the board's position
+  int repetitions(const Board& board) const;
+  // Drawn by either rule: the quiet plies or the third occurrence
+  bool isDraw(const Board& board) const
+  { return board.isStalemate() || repetitions(board) >= 2; }
+
+private:
+  vector<uint32_t> keys;
+};
@@ -0,0 +1,344 @@
+#include "Protocol.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+
+// The depth a go with no limits searches to, as analyze's default
+static const int DEFAULT_DEPTH = 10;
+
+Protocol::Protocol(ostream& o, ThreadPool& p, int megabytes)
+  : out(o), pool(p), searchers(megabytes), running(0)
+{
+}
+Protocol::~Protocol()
+{
+  // The tasks still have to return before the group can go
+  waitAll();
+  while (!searches.done())
+    this_thread::yield();
+}
+
+bool Protocol::handle(const string& line)
+{
+  vector<string> args;
+  istringstream words(line);
+  string word;
+  while (words >> word)
+    args.push_back(word);
+  if (args.empty())
+    return true;
+
+  const string& command = args[0];
+  string id = (args.size() > 1) ? args[1] : "";
+  try
+  {
+    if (command == "quit")
+    {
+      waitAll();
+      return false;
+    }
+    else if (command == "isready")
+    {
+      waitAll();
+      reply("readyok", false);
+    }
+    else if (command == "sessions")
+      reply("sessions " + to_string(sessions.size()), false);
+    else if (command == "stop")
+    {
+      // The search watches the flag, so a stop is kept even if it
+      // comes before the search has started
+      session(id).stopFlag = true;
+    }
+    else if (command == "position")
+    {
+      setPosition(id, args);
+      reply("ok " + id, false);
+    }
+    else
+    {
+      static const string SESSION_COMMANDS = " moves undo legal board go close ";
+      if (SESSION_COMMANDS.find(" " + command + " ") == string::npos)
+        throw "Unrecognized command";
+      Session& s = session(id);
+      refuseIfSearching(s);
+      if (command == "moves")
+      {
+        playMoves(s, args, 2);
+        reply("ok " + id, false);
+      }
+      else if (command == "undo")
+      {
+        int plies = (args.size() > 2) ? atoi(args[2].c_str()) : 1;
+        if (plies < 0 || plies > (int)s.history.size())
+          throw "Not that many moves to take back";
+        for (int i=0; i<plies; i++)
+        {
+          s.board.unmakeMove(s.history.back().first, s.history.back().second);
+          s.history.pop_back();
+          s.positions.pop();
+        }
+        reply("ok " + id, false);
+      }
+      else if (command == "legal")
+      {
+        Board::MoveList list;
+        s.board.generateMoves(s.board.sideToMove(), list);
+        string text = "legal " + id;
+        for (int i=0; i<list.size(); i++)
+          text += " " + moveText(list[i]);
+        reply(text, false);
+      }
+      else if (command == "board")
+        reply("board " + id + " " + s.board.position() + " result " + resultText(s.board, s.positions) +
+          " plies " + to_string(s.history.size()), false);
+      else if (command == "go")
+        go(id, s, args);
+      else
+      {
+        sessions.erase(id);
+        reply("ok " + id, false);
+      }
+    }
+  }
+  catch (const char* message)
+  {
+    bool global = (command == "quit" || command == "isready" || command == "sessions" || id.empty() ||
+      message == string("Unrecognized command"));
+    reply("error " + (global ? "" : id + " ") + message, false);
+  }
+  return true;
+}
+
+void Protocol::flush()
+{
+  lock_guard<mutex> hold(outLock);
+  out.flush();
+}
+
+void Protocol::waitAll()
+{
+  unique_lock<mutex> hold(searchLock);
+  searchDone.wait(hold, [this]() { return running == 0; });
+}
+
+Protocol::Session& Protocol::session(const string& id)
+{
+  if (id.empty())
+    throw "Missing session id";
+  auto it = sessions.find(id);
+  if (it == sessions.end())
+    throw "Unknown session";
+  return *it->second;
+}
+void Protocol::refuseIfSearching(Session& s)
+{
+  lock_guard<mutex> hold(s.lock);
+  if (s.searching)
+    throw "Searching";
+}
+
+void Protocol::setPosition(const string& id, const vector<string>& args)
+{
+  if (id.empty())
+    throw "Missing session id";
+  if (args.size() < 3)
+    throw "Missing position";
+
+  auto it = sessions.find(id);
+  if (it != sessions.end())
+    refuseIfSearching(*it->second);
+
+  // Set up apart, so a bad position or move leaves the session as it was
+  unique_ptr<Session> fresh(new Session());
+  if (args[2] != "start")
+    fresh->board.setPosition(args[2]);
+  size_t first = args.size();
+  if (args.size() > 3)
+  {
+    if (args[3] != "moves")
+      throw "Expected moves after the position";
+    first = 4;
+  }
+  playMoves(*fresh, args, first);
+  sessions[id] = std::move(fresh);
+}
+
+void Protocol::playMoves(Session& s, const vector<string>& moves, size_t first)
+{
+  size_t played = 0;
+  try
+  {
+    for (size_t i=first; i<moves.size(); i++, played++)
+    {
+      Board::Move m = parseMove(s.board, moves[i]);
+      s.positions.push(s.board);
+      s.history.push_back(make_pair(m, s.board.makeMove(m)));
+    }
+  }
+  catch (const char*)
+  {
+    for (; played > 0; played--)
+    {
+      s.board.unmakeMove(s.history.back().first, s.history.back().second);
+      s.history.pop_back();
+      s.positions.pop();
+    }
+    throw;
+  }
+}
+
+SearchLimits Protocol::parseLimits(const vector<string>& args, size_t first)
+{
+  SearchLimits limits;
+  for (size_t i=first; i<args.size(); i += 2)
+  {
+    if (i + 1 >= args.size())
+      throw "Missing search limit value";
+    int value = atoi(args[i + 1].c_str());
+    if (value <= 0)
+      throw "Search limits must be positive";
+    if (args[i] == "depth")
+      limits.depth = value;
+    else if (args[i] == "nodes")
+      limits.nodes = (uint64_t)value;
+    else if (args[i] == "movetime")
+      limits.milliseconds = value;
+    else
+      throw "Unrecognized search limit";
+  }
+  if (limits.depth == 0 && limits.nodes == 0 && limits.milliseconds == 0)
+    limits.depth = DEFAULT_DEPTH;
+  limits.threads = 1;
+  return limits;
+}
+
+void Protocol::go(const string& id, Session& s, const vector<string>& args)
+{
+  SearchLimits limits = parseLimits(args, 2);
+  {
+    lock_guard<mutex> hold(s.lock);
+    s.searching = true;
+    s.stopFlag = false;
+  }
+  {
+    lock_guard<mutex> hold(searchLock);
+    running++;
+  }
+  Board board = s.board;
+  PositionHistory positions = s.positions;
+  Session* session = &s;
+  pool.submit(searches, [this, id, board, positions, limits, session]() {
+    Search* search = searchers.take();
+    search->setStopSignal(&session->stopFlag);
+    SearchResult r = search->run(board, limits, positions);
+    search->setStopSignal(nullptr);
+    searchers.give(search);
+    string line = "bestmove " + id + " " + (r.hasMove ? moveText(r.bestMove) : string("none")) +
+      " score " + to_string(r.score) + " depth " + to_string(r.depth) +
+      " nodes " + to_string(r.nodes) + " ms " + to_string(r.milliseconds);
+
+    // The bestmove goes out and the session takes commands again in one
+    // step under its lock, so nothing for it is handled before the reply,
+    // nor refused after it. It may be closed from then on, so it is left
+    // alone after that
+    {
+      lock_guard<mutex> hold(session->lock);
+      reply(line, true);
+      session->searching = false;
+    }
+    {
+      lock_guard<mutex> hold(searchLock);
+      running--;
+    }
+    searchDone.notify_all();
+  });
+}
+
+void Protocol::reply(const string& line, bool now)
+{
+  lock_guard<mutex> hold(outLock);
+  out << line << '\n';
+  if (now)
+    out.flush();
+}
+
+string Protocol::moveText(const Board::Move& m)
+{
+  string retval = Board::moveName(m);
+  if (m.isJump())
+  {
+    retval += "x";
+    for (int sq=0; sq<Board::SQUARES; sq++)
+      if (m.captures & (1u << sq))
+        retval += Board::squareName(sq);
+  }
+  return retval;
+}
+
+// A square's name, or NO_SQUARE for anything else, light squares included
+static int parseSquare(const string& text, size_t at)
+{
+  if (at + 2 > text.size())
+    return Board::NO_SQUARE;
+  char row = text[at];
+  char col = text[at + 1];
+  if (row < 'a' || row > 'h' || col < '1' || col > '8')
+    return Board::NO_SQUARE;
+  Board::Coord c(row, col - '0');
+  int square = Board::squareOf(c);
+  if (square == Board::NO_SQUARE || Board::coordOf(square) != c)
+    return Board::NO_SQUARE;
+  return square;
+}
+
+Board::Move Protocol::parseMove(const Board& board, const string& text)
+{
+  int from = parseSquare(text, 0);
+  int to = parseSquare(text, 3);
+  if (from == Board::NO_SQUARE || to == Board::NO_SQUARE || text[2] != ',')
+    throw "Unrecognized move";
+
+  bool named = text.size() > 5;
+  uint32_t captures = 0;
+  if (named)
+  {
+    if (text[5] != 'x' || text.size() % 2 != 0)
+      throw "Unrecognized move";
+    for (size_t at=6; at<text.size(); at += 2)
+    {
+      int square = parseSquare(text, at);
+      if (square == Board::NO_SQUARE)
+        throw "Unrecognized move";
+      captures |= 1u << square;
+    }
+  }
+
+  Board::MoveList list;
+  board.generateMoves(board.sideToMove(), list);
+  int found = -1;
+  for (int i=0; i<list.size(); i++)
+  {
+    if (list[i].from() != from || list[i].to() != to || (named && list[i].captures != captures))
+      continue;
+    if (found != -1)
+      throw "Ambiguous move: name its captures";
+    found = i;
+  }
+  if (found == -1)
+    throw "Illegal move";
+  return list[found];
+}
+
+string Protocol::resultText(const Board& board, const PositionHistory& history)
+{
+  int winner = board.isPlayerVictory();
+  if (winner == 1)
+    return "1-0";
+  if (winner == 2)
+    return "0-1";
+  if (history.isDraw(board))
+    return "1/2-1/2";
+  return "*";
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+#include "Evaluation.h"
+#include "PositionHistory.h"
+#include "Search.h"
+#include "ThreadPool.h"
+#include "TranspositionTable.h"
+
+/*
+ * Protocol is a line-based text protocol for driving the engine from
+ * another program, in the spirit of UCI, serving many independent
+ * games ("sessions") at once. Every command but the global ones names
+ * its session first; ids are any word the client likes, and every
+ * reply about a session carries its id, so replies can be matched up
+ * in whatever order they arrive.
+ *
+ *   position <id> start|<position> [moves <move> ...]
+ *                         set up a session, making it if it's new
+ *                         -> ok <id>
+ *   moves <id> <move> ... play moves -> ok <id>
+ *   undo <id> [plies]     take moves back -> ok <id>
+ *   legal <id>            -> legal <id> <move> ...
+ *   board <id>            -> board <id> <position> result <result> plies <n>
+ *   go <id> [depth n] [nodes n] [movetime ms]
+ *                         search, replying when done:
+ *                         -> bestmove <id> <move>|none score <s> depth <d> nodes <n> ms <t>
+ *   stop <id>             end the session's search now; its bestmove follows
+ *   close <id>            forget a session -> ok <id>
+ *   sessions              -> sessions <count>
+ *   isready               wait for every search -> readyok
+ *   quit                  wait for every search, then stop
+ *
+ * Positions are Board::position() notation. Moves are Board::moveName()
+ * ("c1,d2"); a jump may add "x" and the squares it captures
+ * ("e3,c1xd2"), which it must when chains share their end squares.
+ * legal and bestmove always write the captures. Results are 1-0, 0-1,
+ * 1/2-1/2, or * while the game goes on. A command that fails replies
+ * "error <id> <message>" (or "error <message>"), and changes nothing.
+ *
+ * Searches run on a ThreadPool, so one session's search doesn't hold
+ * up the others, nor the thread handling commands: a session that is
+ * searching refuses every command but stop ("error <id> Searching")
+ * until its bestmove has been sent, and isready and quit block until
+ * the searches end rather than helping to run them. Searches come from
+ * a SearcherPool, so there are only ever as many as run at once,
+ * however many sessions there are.
+ *
+ * Replies to commands are written as they are handled but only flushed
+ * by flush(), so a client that sends a batch of commands gets its
+ * replies in one write; bestmove replies are flushed at once.
+ */
+class Protocol
+{
+public:
+  Protocol(ostream& out, ThreadPool& pool, int hashMegabytes);
+  ~Protocol();
+
+  Protocol(const Protocol&) = delete;
+  Protocol& operator=(const Protocol&) = delete;
+
+public:
+  // Returns false once the client has asked to quit
+  bool handle(const string& line);
+  void flush();
+  void waitAll();
+
+  void setEvaluation(const Evaluation& e) { searchers.setEvaluation(e); }
+
+  static string moveText(const Board::Move& m);
+  static Board::Move parseMove(const Board& board, const string& text);
+  static string resultText(const Board& board, const PositionHistory& history);
+  static SearchLimits parseLimits(const vector<string>& args, size_t first);
+
+private:
+  struct Session
+  {
+  public:
+    Board board;
+    vector<pair<Board::Move, Board::Undo> > history;
+    PositionHistory positions; // one a ply, alongside history
+    mutex lock;
+    bool searching; // from go until its bestmove is sent, under lock
+    atomic<bool> stopFlag; // set by stop, the search's stop signal
+
+  public:
+    Session() : searching(false), stopFlag(false) { }
+  };
+
+  Session& session(const string& id);
+  static void refuseIfSearching(Session& s);
+  void setPosition(const string& id, const vector<string>& args);
+  void playMoves(Session& s, const vector<string>& moves, size_t first);
+  void go(const string& id, Session& s, const vector<string>& args);
+  void reply(const string& line, bool now);
+
+private:
+  ostream& out;
+  ThreadPool& pool;
+  SearcherPool searchers;
+  map<string, unique_ptr<Session> > sessions;
+
+  ThreadPool::TaskGroup searches;
+  mutex searchLock;
+  condition_variable searchDone;
+  int running; // searches not yet done, under searchLock
+
+  mutex outLock;
+};
@@ -0,0 +1,102 @@
+#include "Replay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+static const uint64_t GAMES_PER_TASK = 4096;
+
+int Replay::play(const GameArchive::Game& game, Board& board, PositionHistory& history)
+{
+  board = game.startBoard();
+  history.clear();
+  int plies = game.plies();
+  for (int i=0; i<plies; i++)
+  {
+    // The board lets any player move, so the turn is checked here. A
+    // recorded chain must be the very one played; otherwise the
+    // squares are enough
+    Board::Move m;
+    if ((board.playerMask(board.sideToMove()) & (1u << game.from(i))) == 0)
+      return i;
+    if (game.captures(i) != 0)
+    {
+      m = game.move(i);
+      if (!board.isLegal(m))
+        return i;
+    }
+    else if (!board.legalMove(game.from(i), game.to(i), m))
+      return i;
+    history.push(board);
+    board.makeMove(m);
+  }
+  return -1;
+}
+
+int Replay::outcome(const Board& board, const PositionHistory& history)
+{
+  Board::MoveList list;
+  board.generateMoves(board.sideToMove(), list);
+  if (!list.empty())
+    return history.isDraw(board) ? GameRecord::DRAW : GameRecord::UNKNOWN;
+  return Board::opponent(board.sideToMove()) == 1 ? GameRecord::PLAYER1 : GameRecord::PLAYER2;
+}
+
+Replay::Report Replay::run(const GameArchive& archive, ThreadPool& pool)
+{
+  Report report = Report();
+  mutex reportLock;
+  auto start = chrono::steady_clock::now();
+
+  ThreadPool::TaskGroup group;
+  for (uint64_t first=0; first<archive.size(); first+=GAMES_PER_TASK)
+  {
+    pool.submit(group, [&, first]() {
+      Report local = Report();
+      Board board;
+      PositionHistory history;
+      uint64_t last = min(first + GAMES_PER_TASK, archive.size());
+      for (uint64_t g=first; g<last; g++)
+      {
+        GameArchive::Game game = archive.game(g);
+        int bad = play(game, board, history);
+        local.games++;
+        if (bad >= 0)
+        {
+          local.moves += bad;
+          Problem p = { g, bad, game.from(bad), game.to(bad), game.result(), GameRecord::UNKNOWN };
+          local.illegal.push_back(p);
+          continue;
+        }
+
+        local.moves += game.plies();
+        int replayed = outcome(board, history);
+        local.outcomes[replayed]++;
+        int recorded = game.result();
+        bool agrees = (recorded == GameRecord::UNKNOWN) ||
+          (recorded == GameRecord::DRAW ? replayed != GameRecord::PLAYER1 && replayed != GameRecord::PLAYER2 :
+          replayed == recorded);
+        if (!agrees)
+        {
+          Problem p = { g, game.plies(), -1, -1, recorded, replayed };
+          local.mismatched.push_back(p);
+        }
+      }
+
+      lock_guard<mutex> hold(reportLock);
+      report.games += local.games;
+      report.moves += local.moves;
+      for (int i=0; i<4; i++)
+        report.outcomes[i] += local.outcomes[i];
+      report.illegal.insert(report.illegal.end(), local.illegal.begin(), local.illegal.end());
+      report.mismatched.insert(report.mismatched.end(), local.mismatched.begin(), local.mismatched.end());
+    });
+  }
+  pool.wait(group);
+
+  auto byGame = [](const Problem& a, const Problem& b) { return a.game < b.game; };
+  sort(report.illegal.begin(), report.illegal.end(), byGame);
+  sort(report.mismatched.begin(), report.mismatched.end(), byGame);
+  report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return report;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+#include "GameRecord.h"
+#include "PositionHistory.h"
+#include "ThreadPool.h"
+
+/*
+ * Replay checks a game archive against the rules: every move of every
+ * game goes through Board::legalMove() and is then played as
+ * Board::move() would play it, minus the verbose output. A game stops
+ * at its first illegal move.
+ *
+ * A game that replays to a position where the side to move has no
+ * move was won by the other side, and one that replays to a drawn
+ * position (PositionHistory::isDraw()) was drawn. Any other game didn't
+ * end by the rules; a recorded draw may still have been agreed or
+ * capped there. A recorded result that disagrees is a mismatch.
+ */
+class Replay
+{
+public:
+  struct Problem
+  {
+  public:
+    uint64_t game;
+    int ply; // of the illegal move, or the number of plies for a mismatch
+    int from, to;
+    int recorded, replayed; // results, for a mismatch
+  };
+
+  struct Report
+  {
+  public:
+    uint64_t games;
+    uint64_t moves;
+    uint64_t outcomes[4]; // replayed results, as GameRecord::Result
+    vector<Problem> illegal;
+    vector<Problem> mismatched;
+    double seconds;
+  };
+
+public:
+  static Report run(const GameArchive& archive, ThreadPool& pool);
+
+  // Replays one game into board and its positions into history;
+  // returns the ply of its first illegal move, or -1 if all are legal
+  static int play(const GameArchive::Game& game, Board& board, PositionHistory& history);
+  static int outcome(const Board& board, const PositionHistory& history);
+};
@@ -0,0 +1,468 @@
+#include "Search.h"
+
+#include <iomanip>
+
+const int Search::MAX_PLY;
+const int Search::INFINITE_SCORE;
+const int Search::WIN;
+
+Search::Search(TranspositionTable& tt)
+  : tt(tt), info(nullptr), pool(nullptr), tablebase(nullptr), stopSignal(nullptr),
+    stopped(false), nodes(0), publishedNodes(0)
+{
+}
+
+int Search::scoreToTable(int score, int ply)
+{
+  // Win scores count plies from the root; the table needs them
+  // counted from the stored position
+  if (score > WIN - MAX_PLY) return score + ply;
+  if (score < -WIN + MAX_PLY) return score - ply;
+  return score;
+}
+int Search::scoreFromTable(int score, int ply)
+{
+  if (score > WIN - MAX_PLY) return score - ply;
+  if (score < -WIN + MAX_PLY) return score + ply;
+  return score;
+}
+
+int Search::elapsed() const
+{
+  return (int)chrono::duration_cast<chrono::milliseconds>(
+    chrono::steady_clock::now() - start).count();
+}
+
+uint64_t Search::totalNodes() const
+{
+  uint64_t total = nodes;
+  for (size_t i=0; i<helpers.size(); i++)
+    total += helpers[i]->publishedNodes.load(memory_order_relaxed);
+  return total;
+}
+
+bool Search::outOfBudget()
+{
+  if ((nodes & 1023) == 0)
+    publishedNodes.store(nodes, memory_order_relaxed);
+  if (stopped)
+    return true;
+  if (stopSignal != nullptr && stopSignal->load(memory_order_relaxed))
+    stopped = true;
+  else if (limits.nodes != 0 && nodes >= limits.nodes)
+    stopped = true;
+  else if (limits.milliseconds != 0 && (nodes & 1023) == 0 &&
+           elapsed() >= limits.milliseconds)
+    stopped = true;
+  return stopped;
+}
+
+void Search::prepare(const Board& b, const SearchLimits& l, const PositionHistory& game)
+{
+  board = b;
+  history = game;
+  history.reserve(game.size() + MAX_PLY);
+  limits = l;
+  stopped = false;
+  nodes = 0;
+  publishedNodes = 0;
+  start = chrono::steady_clock::now();
+  for (int i=0; i<MAX_PLY; i++)
+  {
+    killers[i][0] = Board::Move();
+    killers[i][1] = Board::Move();
+  }
+}
+
+SearchResult Search::run(const Board& b, const SearchLimits& l, const PositionHistory& game)
+{
+  prepare(b, l, game);
+  tt.newSearch();
+
+  SearchResult result;
+  Board::MoveList rootMoves;
+  board.generateMoves(board.sideToMove(), rootMoves);
+  if (rootMoves.empty())
+  {
+    result.score = -WIN;
+    return result;
+  }
+
+  // Lazy SMP helpers: the main thread decides when they stop
+  ThreadPool::TaskGroup group;
+  if (pool != nullptr && limits.threads > 1)
+  {
+    SearchLimits helperLimits;
+    helperLimits.depth = limits.depth;
+    for (int i=1; i<limits.threads; i++)
+    {
+      helpers.push_back(unique_ptr<Search>(new Search(tt)));
+      Search* helper = helpers.back().get();
+      helper->tablebase = tablebase;
+      helper->evaluation = evaluation;
+      helper->prepare(b, helperLimits, game);
+      int firstDepth = 1 + (i % 2);
+      pool->submit(group, [helper, firstDepth]() {
+        SearchResult ignored;
+        Board::MoveList moves;
+        helper->board.generateMoves(helper->board.sideToMove(), moves);
+        helper->iterate(ignored, moves, firstDepth);
+      });
+    }
+  }
+
+  iterate(result, rootMoves, 1);
+
+  for (size_t i=0; i<helpers.size(); i++)
+    helpers[i]->stop();
+  if (!helpers.empty())
+    pool->wait(group);
+
+  result.nodes = nodes;
+  for (size_t i=0; i<helpers.size(); i++)
+    result.nodes += helpers[i]->nodes;
+  result.milliseconds = elapsed();
+  result.memory = tt.bytesUsed() + sizeof(Search) * (1 + helpers.size());
+  helpers.clear();
+  return result;
+}
+
+void Search::iterate(SearchResult& result, Board::MoveList& rootMoves, int firstDepth)
+{
+  // Always have something to play, even if the first iteration
+  // runs out of budget
+  result.hasMove = true;
+  result.bestMove = rootMoves[0];
+
+  int maxDepth = (limits.depth > 0 && limits.depth < MAX_PLY - 1) ?
+    limits.depth : MAX_PLY - 1;
+  uint64_t previousNodes = 0;
+  int score = 0;
+  for (int depth=firstDepth; depth<=maxDepth; depth++)
+  {
+    uint64_t before = totalNodes();
+
+    // Aspiration window: expect this iteration's score to be near the
+    // last one, and widen the side that fails
+    int window = 50;
+    int alpha = -INFINITE_SCORE;
+    int beta = INFINITE_SCORE;
+    if (depth >= 3)
+    {
+      alpha = max(score - window, -INFINITE_SCORE);
+      beta = min(score + window, INFINITE_SCORE);
+    }
+
+    int s;
+    while (true)
+    {
+      s = negamax(depth, alpha, beta, 0);
+      if (stopped)
+        break;
+      if (s <= alpha)
+        alpha = max(s - window, -INFINITE_SCORE);
+      else if (s >= beta)
+        beta = min(s + window, INFINITE_SCORE);
+      else
+        break;
+      window *= 4;
+    }
+    if (stopped)
+      break;
+
+    uint64_t iterationNodes = totalNodes() - before;
+    score = s;
+    result.score = s;
+    result.depth = depth;
+    result.bestMove = pv[0][0];
+    result.pv.assign(pv[0], pv[0] + pvLength[0]);
+    extendPv(result.pv, depth);
+    report(depth, s, iterationNodes, previousNodes, result.pv);
+    previousNodes = iterationNodes;
+
+    // A forced win or loss inside the horizon won't change
+    if (isWinScore(s) && WIN - abs(s) < depth)
+      break;
+    if (rootMoves.size() == 1)
+      break;
+  }
+}
+
+void Search::extendPv(vector<Board::Move>& line, int depth)
+{
+  // Table cutoffs cut the PV short; follow the table's best moves
+  // past the end of it, as long as they are legal
+  Board scratch = board;
+  for (size_t i=0; i<line.size(); i++)
+    scratch.makeMove(line[i]);
+
+  TranspositionTable::Entry entry;
+  while ((int)line.size() < depth)
+  {
+    int image = scratch.symmetry();
+    if (!tt.probe(scratch.hash(image), entry))
+      break;
+
+    // The table keeps a move's bits, not its captures; the generated
+    // move with the same bits is the whole of it
+    Board::Move m = Board::transformMove(Board::inverseSymmetry(image), entry.move);
+    Board::MoveList list;
+    scratch.generateMoves(scratch.sideToMove(), list);
+    int found = -1;
+    for (int i=0; i<list.size() && found == -1; i++)
+    {
+      if (list[i].bits == m.bits)
+        found = i;
+    }
+    if (found == -1)
+      break;
+    line.push_back(list[found]);
+    scratch.makeMove(list[found]);
+  }
+}
+
+vector<SearchResult> Search::analyze(const vector<Board>& boards, const SearchLimits& limits)
+{
+  vector<SearchResult> results;
+  results.reserve(boards.size());
+  for (size_t i=0; i<boards.size(); i++)
+    results.push_back(run(boards[i], limits));
+  return results;
+}
+
+void Search::orderMoves(Board::MoveList& list, Board::Move* ordered,
+  Board::Move first, int ply)
+{
+  // Table move (matched on its bits, which is all the table keeps),
+  // then jumps, then killers, then everything else
+  int n = 0;
+  bool used[Board::MoveList::CAPACITY] = { };
+  for (int i=0; i<list.size(); i++)
+  {
+    if (first.bits != 0 && list[i].bits == first.bits)
+    {
+      ordered[n++] = list[i];
+      used[i] = true;
+    }
+  }
+  for (int i=0; i<list.size(); i++)
+  {
+    if (!used[i] && list[i].isJump())
+    {
+      ordered[n++] = list[i];
+      used[i] = true;
+    }
+  }
+  for (int k=0; k<2; k++)
+  {
+    for (int i=0; i<list.size(); i++)
+    {
+      if (!used[i] && list[i] == killers[ply][k])
+      {
+        ordered[n++] = list[i];
+        used[i] = true;
+      }
+    }
+  }
+  for (int i=0; i<list.size(); i++)
+  {
+    if (!used[i])
+      ordered[n++] = list[i];
+  }
+}
+
+bool Search::probeTablebase(int ply, int& score)
+{
+  if (tablebase == nullptr ||
+      __builtin_popcount(board.occupiedMask()) > tablebase->maxPieces())
+    return false;
+
+  Tablebase::Result r;
+  if (!tablebase->probe(board, r))
+    return false;
+
+  // Distances past the search horizon still have to read as wins
+  int plies = min(ply + r.plies, MAX_PLY - 1);
+  if (r.outcome == Tablebase::WIN)
+    score = WIN - plies;
+  else if (r.outcome == Tablebase::LOSS)
+    score = -WIN + plies;
+  else
+    score = 0;
+  return true;
+}
+
+int Search::negamax(int depth, int alpha, int beta, int ply)
+{
+  pvLength[ply] = ply;
+  if (depth <= 0)
+    return quiesce(alpha, beta, ply);
+
+  nodes++;
+  if (outOfBudget())
+    return 0;
+  if (ply >= MAX_PLY - 1)
+    return evaluate(board);
+
+  if (ply > 0 && history.isDraw(board))
+    return 0;
+
+  int tableScore;
+  if (ply > 0 && probeTablebase(ply, tableScore))
+    return tableScore;
+
+  int originalAlpha = alpha;
+  Board::Move tableMove;
+  TranspositionTable::Entry entry;
+  int image = board.symmetry(); // to the representative, which the hash is of
+  uint64_t key = board.hash(image);
+  if (tt.probe(key, entry))
+  {
+    // The table is shared by every image of the position, so its move
+    // is stored as it would be played in the representative
+    if (entry.move != Board::Move())
+      tableMove = Board::transformMove(Board::inverseSymmetry(image), entry.move);
+    if (ply > 0 && entry.depth >= depth)
+    {
+      int s = scoreFromTable(entry.score, ply);
+      if (entry.bound == TranspositionTable::EXACT ||
+          (entry.bound == TranspositionTable::LOWER && s >= beta) ||
+          (entry.bound == TranspositionTable::UPPER && s <= alpha))
+        return s;
+    }
+  }
+
+  Board::MoveList list;
+  board.generateMoves(board.sideToMove(), list);
+  if (list.empty())
+    return -WIN + ply;
+
+  Board::Move ordered[Board::MoveList::CAPACITY];
+  orderMoves(list, ordered, tableMove, ply);
+
+  int best = -INFINITE_SCORE;
+  Board::Move bestMove = ordered[0];
+  for (int i=0; i<list.size(); i++)
+  {
+    Board::Move m = ordered[i];
+    history.push(board);
+    Board::Undo undo = board.makeMove(m);
+    int score = -negamax(depth - 1, -beta, -alpha, ply + 1);
+    board.unmakeMove(m, undo);
+    history.pop();
+    if (stopped)
+      return 0;
+
+    if (score > best)
+    {
+      best = score;
+      bestMove = m;
+      if (score > alpha)
+      {
+        alpha = score;
+        pv[ply][ply] = m;
+        for (int j=ply+1; j<pvLength[ply+1]; j++)
+          pv[ply][j] = pv[ply+1][j];
+        pvLength[ply] = pvLength[ply+1];
+
+        if (alpha >= beta)
+        {
+          if (!m.isJump() && killers[ply][0] != m)
+          {
+            killers[ply][1] = killers[ply][0];
+            killers[ply][0] = m;
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  TranspositionTable::Bound bound =
+    best <= originalAlpha ? TranspositionTable::UPPER :
+    best >= beta ? TranspositionTable::LOWER : TranspositionTable::EXACT;
+  tt.store(key, depth, bound, scoreToTable(best, ply), Board::transformMove(image, bestMove));
+  return best;
+}
+
+int Search::quiesce(int alpha, int beta, int ply)
+{
+  pvLength[ply] = ply;
+  nodes++;
+  if (outOfBudget())
+    return 0;
+
+  Board::MoveList list;
+  board.generateMoves(board.sideToMove(), list);
+  if (list.empty())
+    return -WIN + ply;
+
+  int standPat = evaluate(board);
+  if (standPat >= beta || ply >= MAX_PLY - 1)
+    return standPat;
+  if (standPat > alpha)
+    alpha = standPat;
+
+  // Only jumps; the generator lists them first. A jump leaves nothing
+  // earlier to repeat, so the history needs no push
+  for (int i=0; i<list.size() && list[i].isJump(); i++)
+  {
+    Board::Move m = list[i];
+    Board::Undo undo = board.makeMove(m);
+    int score = -quiesce(-beta, -alpha, ply + 1);
+    board.unmakeMove(m, undo);
+    if (stopped)
+      return 0;
+
+    if (score > alpha)
+    {
+      alpha = score;
+      pv[ply][ply] = m;
+      for (int j=ply+1; j<pvLength[ply+1]; j++)
+        pv[ply][j] = pv[ply+1][j];
+      pvLength[ply] = pvLength[ply+1];
+      if (alpha >= beta)
+        break;
+    }
+  }
+  return alpha;
+}
+
+void Search::report(int depth, int score, uint64_t iterationNodes,
+  uint64_t previousNodes, const vector<Board::Move>& line)
+{
+  if (info == nullptr)
+    return;
+
+  int ms = elapsed();
+  uint64_t all = totalNodes();
+  uint64_t nps = all * 1000 / (uint64_t)(ms > 0 ? ms : 1);
+  (*info) << "info depth " << depth << " score " << score
+    << " nodes " << all << " time " << ms << " nps " << nps;
+  if (previousNodes > 0)
+    (*info) << " ebf " << fixed << setprecision(2)
+      << (double)iterationNodes / (double)previousNodes;
+  (*info) << " pv";
+  for (size_t i=0; i<line.size(); i++)
+    (*info) << " " << Board::moveName(line[i]);
+  (*info) << endl;
+}
+
+Search* SearcherPool::take()
+{
+  lock_guard<mutex> hold(lock);
+  if (idle.empty())
+  {
+    searchers.push_back(unique_ptr<Searcher>(new Searcher(hashMegabytes)));
+    searchers.back()->search.setEvaluation(evaluation);
+    idle.push_back(&searchers.back()->search);
+  }
+  Search* search = idle.back();
+  idle.pop_back();
+  return search;
+}
+void SearcherPool::give(Search* search)
+{
+  lock_guard<mutex> hold(lock);
+  idle.push_back(search);
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+#include "Evaluation.h"
+#include "PositionHistory.h"
+#include "Tablebase.h"
+#include "ThreadPool.h"
+#include "TranspositionTable.h"
+
+/*
+ * SearchLimits bounds a search; zero means "no limit" for each field.
+ * Node limits count the main thread's nodes only.
+ */
+struct SearchLimits
+{
+public:
+  int depth;
+  uint64_t nodes;
+  int milliseconds;
+  int threads;
+
+public:
+  SearchLimits() : depth(0), nodes(0), milliseconds(0), threads(1) { }
+
+public:
+  static SearchLimits toDepth(int d) { SearchLimits l; l.depth = d; return l; }
+  static SearchLimits forNodes(uint64_t n) { SearchLimits l; l.nodes = n; return l; }
+  static SearchLimits forTime(int ms) { SearchLimits l; l.milliseconds = ms; return l; }
+};
+
+/*
+ * SearchResult is what the last completed iteration found, plus the
+ * totals for the whole search.
+ */
+struct SearchResult
+{
+public:
+  bool hasMove;
+  Board::Move bestMove;
+  int score; // from the side to move's point of view
+  int depth;
+  uint64_t nodes;
+  int milliseconds;
+  uint64_t memory; // bytes in use: the table slots this search wrote or the tree, and scratch
+  vector<Board::Move> pv;
+
+public:
+  SearchResult() : hasMove(false), score(0), depth(0), nodes(0), milliseconds(0), memory(0) { }
+};
+
+/*
+ * Search picks a move for the side to move with negamax alpha-beta:
+ * iterative deepening, aspiration windows around the previous
+ * iteration's score, a principal variation table, and a jumps-only
+ * quiescence search at the leaves. Results are shared through a
+ * TranspositionTable.
+ *
+ * Each iteration reports depth, score, nodes, nodes/sec and effective
+ * branching factor (this iteration's nodes over the last one's) to the
+ * info stream, if one is set.
+ *
+ * With a ThreadPool and limits.threads > 1 the search is Lazy SMP:
+ * helper threads run the same iterative deepening on their own Board,
+ * half of them a ply ahead, and feed the shared table; the main
+ * thread's result is the answer, and helpers stop when it does.
+ *
+ * With a Tablebase, positions below the root that it covers are scored
+ * from it instead of being searched.
+ *
+ * Leaves are scored by an Evaluation, the default weights unless
+ * setEvaluation() gives others.
+ *
+ * The positions the game went through before the root, if run() is
+ * given them, count towards repetitions found in the search; the
+ * search keeps its own stack of them, pushing a position a ply.
+ *
+ * stop() ends the search in progress; a stop signal set with
+ * setStopSignal() ends any search once the flag it points at is true,
+ * even if it was set before run() began, which stop() can't promise.
+ */
+class Search
+{
+public:
+  static const int MAX_PLY = 64;
+  static const int INFINITE_SCORE = 32000;
+  static const int WIN = 30000; // minus plies to the win
+
+public:
+  Search(TranspositionTable& tt);
+
+public:
+  SearchResult run(const Board& board, const SearchLimits& limits,
+    const PositionHistory& game = PositionHistory());
+  vector<SearchResult> analyze(const vector<Board>& boards, const SearchLimits& limits);
+
+  void setInfo(ostream* out) { info = out; }
+  void setPool(ThreadPool* p) { pool = p; }
+  void setTablebase(const Tablebase* t) { tablebase = t; }
+  void setEvaluation(const Evaluation& e) { evaluation = e; }
+  void stop() { stopped = true; }
+  void setStopSignal(const atomic<bool>* signal) { stopSignal = signal; }
+
+  int evaluate(const Board& b) const { return evaluation.score(b); }
+  static bool isWinScore(int score) { return score > WIN - MAX_PLY || score < -WIN + MAX_PLY; }
+
+private:
+  void prepare(const Board& b, const SearchLimits& l, const PositionHistory& game);
+  void iterate(SearchResult& result, Board::MoveList& rootMoves, int firstDepth);
+  uint64_t totalNodes() const;
+  void extendPv(vector<Board::Move>& line, int depth);
+  int negamax(int depth, int alpha, int beta, int ply);
+  int quiesce(int alpha, int beta, int ply);
+  bool probeTablebase(int ply, int& score);
+  void orderMoves(Board::MoveList& list, Board::Move* ordered, Board::Move first, int ply);
+  bool outOfBudget();
+  void report(int depth, int score, uint64_t iterationNodes,
+    uint64_t previousNodes, const vector<Board::Move>& line);
+  int elapsed() const;
+
+  static int scoreToTable(int score, int ply);
+  static int scoreFromTable(int score, int ply);
+
+private:
+  TranspositionTable& tt;
+  ostream* info;
+  ThreadPool* pool;
+  const Tablebase* tablebase;
+  const atomic<bool>* stopSignal;
+  Evaluation evaluation;
+  vector<unique_ptr<Search> > helpers;
+  Board board;
+  PositionHistory history; // the game's positions, then one per ply searched
+  SearchLimits limits;
+  atomic<bool> stopped;
+  uint64_t nodes;
+  atomic<uint64_t> publishedNodes; // nodes, as other threads may read it
+  chrono::steady_clock::time_point start;
+
+  Board::Move pv[MAX_PLY][MAX_PLY];
+  int pvLength[MAX_PLY];
+  Board::Move killers[MAX_PLY][2];
+};
+
+/*
+ * SearcherPool lends Searches, each with its own TranspositionTable,
+ * to whichever thread wants to search next, and makes a new one only
+ * when every one it has is lent out. Servers with many games in play
+ * need only as many as search at once.
+ */
+class SearcherPool
+{
+public:
+  SearcherPool(int hashMegabytes) : hashMegabytes(hashMegabytes) { }
+
+  SearcherPool(const SearcherPool&) = delete;
+  SearcherPool& operator=(const SearcherPool&) = delete;
+
+public:
+  Search* take();
+  void give(Search* search);
+
+  void setEvaluation(const Evaluation& e) { evaluation = e; }
+
+private:
+  struct Searcher
+  {
+  public:
+    TranspositionTable tt;
+    Search search;
+
+  public:
+    Searcher(int megabytes) : tt(megabytes), search(tt) { }
+  };
+
+private:
+  int hashMegabytes;
+  Evaluation evaluation;
+  mutex lock;
+  vector<unique_ptr<Searcher> > searchers;
+  vector<Search*> idle;
+};
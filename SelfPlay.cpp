@@ -0,0 +1,186 @@
+#include "SelfPlay.h"
+
+#include <chrono>
+#include <mutex>
+#include <random>
+
+void SelfPlay::play(Board& board, Search& search, const Settings& settings, int number, Game& game)
+{
+  auto start = chrono::steady_clock::now();
+  game.number = number;
+  game.winner = 0;
+  game.randomPlies = 0;
+  game.moves.clear();
+  game.scores.clear();
+  game.nodes = 0;
+
+  // Each game's opening depends only on the seed and its number
+  mt19937_64 random(settings.seed * 0x9E3779B97F4A7C15ull + (uint64_t)number);
+  SearchLimits limits = settings.limits;
+  limits.threads = 1;
+
+  Board::MoveList list;
+  PositionHistory history;
+  history.reserve(settings.maxPlies);
+  while ((int)game.moves.size() < settings.maxPlies)
+  {
+    board.generateMoves(board.sideToMove(), list);
+    if (list.empty())
+    {
+      game.winner = Board::opponent(board.sideToMove());
+      break;
+    }
+    if (history.isDraw(board))
+      break;
+
+    Board::Move m;
+    if ((int)game.moves.size() < settings.randomPlies)
+    {
+      m = list[(int)(random() % (uint64_t)list.size())];
+      game.randomPlies++;
+    }
+    else
+    {
+      SearchResult r = search.run(board, limits, history);
+      m = r.bestMove;
+      game.scores.push_back(r.score);
+      game.nodes += r.nodes;
+    }
+    game.moves.push_back(m);
+    history.push(board);
+    board.makeMove(m);
+  }
+
+  game.milliseconds = (int)chrono::duration_cast<chrono::milliseconds>(
+    chrono::steady_clock::now() - start).count();
+}
+
+string SelfPlay::record(const Game& game)
+{
+  string retval = "game " + to_string(game.number) + " result " +
+    (game.winner == 1 ? "1-0" : game.winner == 2 ? "0-1" : "1/2-1/2") +
+    " plies " + to_string(game.moves.size()) + " ms " + to_string(game.milliseconds) +
+    " nodes " + to_string(game.nodes) + " moves";
+  for (size_t i=0; i<game.moves.size(); i++)
+  {
+    retval += " " + Board::moveName(game.moves[i]);
+    if ((int)i >= game.randomPlies)
+      retval += ":" + to_string(game.scores[i - game.randomPlies]);
+  }
+  return retval + "\n";
+}
+
+SelfPlay::Summary SelfPlay::run(const Settings& settings, ThreadPool& pool, ostream& out, ostream* progress)
+{
+  string text;
+  return runBatches(settings, pool, [&](const vector<Game>& batch, int games) {
+    text.clear();
+    for (int i=0; i<games; i++)
+      text += record(batch[i]);
+    out.write(text.data(), text.size());
+    out.flush();
+  }, progress);
+}
+
+SelfPlay::Summary SelfPlay::run(const Settings& settings, ThreadPool& pool, GameWriter& archive, ostream* progress)
+{
+  GameRecord r;
+  return runBatches(settings, pool, [&](const vector<Game>& batch, int games) {
+    for (int i=0; i<games; i++)
+    {
+      const Game& game = batch[i];
+      r.clear();
+      r.result = game.winner; // 0 is GameRecord::DRAW
+      r.moves = game.moves;
+      r.scores.assign(game.randomPlies, GameRecord::NO_SCORE);
+      r.scores.insert(r.scores.end(), game.scores.begin(), game.scores.end());
+      archive.add(r);
+    }
+  }, progress);
+}
+
+SelfPlay::Summary SelfPlay::runBatches(const Settings& settings, ThreadPool& pool,
+  function<void(const vector<Game>&, int)> write, ostream* progress)
+{
+  Summary summary = Summary();
+  atomic<int> next(0);
+  mutex outLock;
+  const char* failure = nullptr; // the first writer error, under outLock
+  auto start = chrono::steady_clock::now();
+  const Board initial;
+
+  // Called with outLock held
+  auto flush = [&](const vector<Game>& batch, const Summary& local) {
+    write(batch, local.games);
+
+    summary.games += local.games;
+    for (int i=0; i<3; i++)
+      summary.results[i] += local.results[i];
+    summary.plies += local.plies;
+    summary.nodes += local.nodes;
+    summary.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (progress != nullptr)
+      (*progress) << summary.games << "/" << settings.games << " games, "
+        << (uint64_t)summary.gamesPerHour() << " games/hour" << endl;
+  };
+
+  // Each task plays games until none are left
+  auto playGames = [&]() {
+    Board board;
+    TranspositionTable tt(settings.hashMegabytes);
+    Search search(tt);
+    search.setEvaluation(settings.evaluation);
+    vector<Game> batch(max(settings.batchGames, 1));
+    Summary local = Summary();
+
+    for (int n = next++; n < settings.games; n = next++)
+    {
+      board = initial;
+      tt.clear();
+      Game& game = batch[local.games];
+      play(board, search, settings, n, game);
+      local.games++;
+      local.results[game.winner]++;
+      local.plies += game.moves.size();
+      local.nodes += game.nodes;
+
+      if (local.games == (int)batch.size())
+      {
+        lock_guard<mutex> hold(outLock);
+        flush(batch, local);
+        local = Summary();
+      }
+    }
+    if (local.games > 0)
+    {
+      lock_guard<mutex> hold(outLock);
+      flush(batch, local);
+    }
+  };
+
+  ThreadPool::TaskGroup group;
+  for (int t=0; t<max(settings.threads, 1); t++)
+  {
+    pool.submit(group, [&]() {
+      // An exception must not escape into the pool, so the first one is
+      // kept and rethrown once every task is done
+      try
+      {
+        playGames();
+      }
+      catch (const char* message)
+      {
+        lock_guard<mutex> hold(outLock);
+        if (failure == nullptr)
+          failure = message;
+        next = settings.games; // the others stop after their current game
+      }
+    });
+  }
+  pool.wait(group);
+  if (failure != nullptr)
+    throw failure;
+
+  summary.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return summary;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+#include "GameRecord.h"
+#include "PositionHistory.h"
+#include "Search.h"
+#include "ThreadPool.h"
+
+/*
+ * SelfPlay plays the engine against itself, many games at once. Every
+ * game starts from the normal position with a few random moves, so
+ * games differ, and then both sides search within the same per-move
+ * budget. A game ends when the side to move has no move (it loses),
+ * when PositionHistory::isDraw() says it is drawn, or after maxPlies plies
+ * (also a draw).
+ *
+ * run() gives every thread its own Board, TranspositionTable and
+ * Search, reused from game to game. Finished games are kept in the
+ * thread's own batch and written out batchGames at a time, so the
+ * output sees a few large writes rather than one per move: either
+ * to a GameWriter archive, or as text, one line per game:
+ *   game 7 result 1-0 plies 83 ms 412 nodes 160342 moves c1,d2 f2,e3 c3,d4:25 ...
+ * where result is 1-0 (player 1 won), 0-1 or 1/2-1/2, and searched
+ * moves carry the score the mover expected, after a colon. If a write
+ * fails, the threads stop after their current game and run() throws
+ * the error.
+ */
+class SelfPlay
+{
+public:
+  struct Settings
+  {
+  public:
+    int games;
+    int threads;
+    SearchLimits limits; // per move
+    int randomPlies;
+    int maxPlies;
+    uint64_t seed;
+    int hashMegabytes; // per thread
+    int batchGames;
+    Evaluation evaluation;
+
+  public:
+    Settings() : games(100), threads(1), randomPlies(4), maxPlies(200), seed(1),
+      hashMegabytes(4), batchGames(16)
+    { limits.nodes = 2000; }
+  };
+
+  struct Game
+  {
+  public:
+    int number;
+    int winner; // 1 or 2, or 0 for a draw
+    int randomPlies;
+    vector<Board::Move> moves;
+    vector<int> scores; // one per searched move, after the random ones
+    int milliseconds;
+    uint64_t nodes;
+  };
+
+  struct Summary
+  {
+  public:
+    int games;
+    int results[3]; // draws, player 1 wins, player 2 wins
+    uint64_t plies;
+    uint64_t nodes;
+    double seconds;
+
+  public:
+    double gamesPerHour() const { return seconds > 0 ? games * 3600.0 / seconds : 0; }
+  };
+
+public:
+  static void play(Board& board, Search& search, const Settings& settings, int number, Game& game);
+  static Summary run(const Settings& settings, ThreadPool& pool, ostream& out, ostream* progress);
+  static Summary run(const Settings& settings, ThreadPool& pool, GameWriter& archive, ostream* progress);
+  static string record(const Game& game);
+
+private:
+  static Summary runBatches(const Settings& settings, ThreadPool& pool,
+    function<void(const vector<Game>&, int)> write, ostream* progress);
+};
@@ -0,0 +1,493 @@
+#include "Server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Protocol.h"
+
+// A line longer than this is not a command; its connection is dropped
+static const size_t MAX_LINE = 65536;
+
+Server::Server(ThreadPool& p, int hashMegabytes)
+  : pool(p), searchers(hashMegabytes), port(0), stopping(false), serials(0), moves(0), searched(0)
+{
+  epoll = epoll_create1(EPOLL_CLOEXEC);
+  wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll < 0 || wake < 0)
+    throw "Unable to set up the event loop";
+  epoll_event e = epoll_event();
+  e.events = EPOLLIN;
+  e.data.fd = wake;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, wake, &e);
+}
+Server::~Server()
+{
+  pool.wait(searches);
+  for (auto it = connections.begin(); it != connections.end(); ++it)
+    ::close(it->first);
+  for (size_t i=0; i<listeners.size(); i++)
+    ::close(listeners[i]);
+  if (!unixPath.empty())
+    unlink(unixPath.c_str());
+  ::close(wake);
+  ::close(epoll);
+}
+
+void Server::listenUnix(const string& path)
+{
+  sockaddr_un address = sockaddr_un();
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    throw "Socket path too long";
+  strcpy(address.sun_path, path.c_str());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  unlink(path.c_str());
+  if (fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) < 0)
+    throw "Unable to bind the Unix socket";
+  unixPath = path;
+  listenOn(fd);
+}
+void Server::listenTcp(int p)
+{
+  sockaddr_in address = sockaddr_in();
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons((uint16_t)p);
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int yes = 1;
+  if (fd >= 0)
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  if (fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) < 0)
+    throw "Unable to bind the TCP port";
+  socklen_t length = sizeof(address);
+  getsockname(fd, (sockaddr*)&address, &length);
+  port = ntohs(address.sin_port);
+  listenOn(fd);
+}
+void Server::listenOn(int fd)
+{
+  if (::listen(fd, SOMAXCONN) < 0)
+    throw "Unable to listen";
+  listeners.push_back(fd);
+  epoll_event e = epoll_event();
+  e.events = EPOLLIN;
+  e.data.fd = fd;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &e);
+}
+
+void Server::run()
+{
+  epoll_event events[64];
+  while (!stopping)
+  {
+    int n = epoll_wait(epoll, events, 64, -1);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw "epoll_wait failed";
+    }
+    for (int i=0; i<n; i++)
+    {
+      int fd = events[i].data.fd;
+      if (fd == wake)
+      {
+        uint64_t count;
+        while (read(wake, &count, sizeof(count)) > 0) { }
+        deliver();
+        continue;
+      }
+      bool listener = false;
+      for (size_t l=0; l<listeners.size(); l++)
+        listener |= (listeners[l] == fd);
+      if (listener)
+      {
+        accept(fd);
+        continue;
+      }
+      if (connections.count(fd) == 0)
+        continue; // closed by an earlier event in this batch
+      if ((events[i].events & (EPOLLHUP | EPOLLERR)) && connections[fd].closing)
+      {
+        close(fd); // nobody is left to read what it is owed
+        continue;
+      }
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        receive(fd);
+      if ((events[i].events & EPOLLOUT) && connections.count(fd))
+        send(fd);
+    }
+  }
+}
+void Server::stop()
+{
+  stopping = true;
+  uint64_t one = 1;
+  if (write(wake, &one, sizeof(one)) < 0) { }
+}
+
+void Server::accept(int listener)
+{
+  for (;;)
+  {
+    int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+      return;
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)); // fails harmlessly on Unix sockets
+    Connection& c = connections[fd];
+    c.serial = ++serials;
+    c.in.clear();
+    c.out.clear();
+    c.writing = false;
+    c.closing = false;
+    c.searching = 0;
+    epoll_event e = epoll_event();
+    e.events = EPOLLIN;
+    e.data.fd = fd;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &e);
+  }
+}
+
+void Server::receive(int fd)
+{
+  Connection& c = connections[fd];
+  char buffer[4096];
+  bool hungUp = false;
+  for (;;)
+  {
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n > 0)
+    {
+      c.in.append(buffer, (size_t)n);
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n == 0)
+    {
+      // The client is done sending, but may still be reading: answer
+      // what it sent first, searches too, and close once that is written
+      hungUp = true;
+      break;
+    }
+    close(fd); // the socket failed
+    return;
+  }
+
+  // Every whole line, then one write for all their replies
+  size_t start = 0;
+  for (size_t end = c.in.find('\n'); end != string::npos && !c.closing; end = c.in.find('\n', start))
+  {
+    handle(fd, c, c.in.substr(start, end - start));
+    start = end + 1;
+  }
+  c.in.erase(0, start);
+  if (hungUp)
+    c.closing = true;
+  else if (c.in.size() > MAX_LINE)
+  {
+    close(fd);
+    return;
+  }
+  send(fd);
+}
+
+void Server::send(int fd)
+{
+  Connection& c = connections[fd];
+  size_t sent = 0;
+  while (sent < c.out.size())
+  {
+    ssize_t n = write(fd, c.out.data() + sent, c.out.size() - sent);
+    if (n > 0)
+      sent += (size_t)n;
+    else if (n < 0 && errno == EINTR)
+      continue;
+    else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    else
+    {
+      close(fd);
+      return;
+    }
+  }
+  c.out.erase(0, sent);
+  if (c.out.empty() && c.closing && c.searching == 0)
+  {
+    close(fd);
+    return;
+  }
+  if (c.out.empty() == c.writing || c.closing)
+    watch(fd, !c.out.empty());
+}
+
+void Server::watch(int fd, bool writing)
+{
+  // A closing connection reads nothing more, so it isn't woken for it
+  Connection& c = connections[fd];
+  c.writing = writing;
+  epoll_event e = epoll_event();
+  e.events = (c.closing ? 0 : EPOLLIN) | (writing ? EPOLLOUT : 0);
+  e.data.fd = fd;
+  epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &e);
+}
+
+void Server::close(int fd)
+{
+  epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+  ::close(fd);
+  connections.erase(fd);
+}
+
+void Server::deliver()
+{
+  vector<Finished> done;
+  {
+    lock_guard<mutex> hold(finishedLock);
+    done.swap(finished);
+  }
+  for (size_t i=0; i<done.size(); i++)
+  {
+    searched++;
+    auto game = games.find(done[i].id);
+    if (game != games.end())
+      game->second.searching = false;
+    auto c = connections.find(done[i].fd);
+    if (c == connections.end() || c->second.serial != done[i].serial)
+      continue; // the client has gone
+    c->second.searching--;
+    c->second.out += done[i].reply;
+    send(done[i].fd);
+  }
+}
+
+void Server::handle(int fd, Connection& c, const string& line)
+{
+  vector<string> args;
+  istringstream words(line);
+  string word;
+  while (words >> word)
+    args.push_back(word);
+  if (args.empty())
+    return;
+
+  const string& command = args[0];
+  string id = (args.size() > 1) ? args[1] : "";
+  try
+  {
+    if (command == "quit")
+      c.closing = true;
+    else if (command == "isready")
+      c.out += "readyok\n";
+    else if (command == "sessions")
+      c.out += "sessions " + to_string(games.size()) + "\n";
+    else if (command == "stats")
+      c.out += "stats connections " + to_string(connections.size()) + " games " +
+        to_string(games.size()) + " moves " + to_string(moves) + " searches " +
+        to_string(searched) + "\n";
+    else
+    {
+      static const string GAME_COMMANDS = " position moves legal board go close ";
+      if (GAME_COMMANDS.find(" " + command + " ") == string::npos)
+        throw "Unrecognized command";
+      if (id.empty())
+        throw "Missing session id";
+      auto it = games.find(id);
+      if (it == games.end() && command != "position")
+        throw "Unknown session";
+      if (it != games.end() && it->second.searching)
+        throw "Searching";
+
+      if (command == "position")
+      {
+        // Set up apart, so a bad position or move leaves the game as it was
+        if (args.size() < 3)
+          throw "Missing position";
+        if (args.size() > 3 && args[3] != "moves")
+          throw "Expected moves after the position";
+        Game fresh;
+        if (args[2] != "start")
+          fresh.board.setPosition(args[2]);
+        for (size_t i=4; i<args.size(); i++)
+        {
+          Board::Move m = Protocol::parseMove(fresh.board, args[i]);
+          fresh.history.push(fresh.board);
+          fresh.board.makeMove(m);
+        }
+        moves += fresh.history.size();
+        games[id] = std::move(fresh);
+        c.out += "ok " + id + "\n";
+      }
+      else if (command == "moves")
+      {
+        Game& game = it->second;
+        Board board = game.board;
+        size_t before = game.history.size();
+        try
+        {
+          for (size_t i=2; i<args.size(); i++)
+          {
+            Board::Move m = Protocol::parseMove(board, args[i]);
+            game.history.push(board);
+            board.makeMove(m);
+          }
+        }
+        catch (const char*)
+        {
+          game.history.truncate(before);
+          throw;
+        }
+        game.board = board;
+        moves += args.size() - 2;
+        c.out += "ok " + id + "\n";
+      }
+      else if (command == "legal")
+      {
+        Board::MoveList list;
+        it->second.board.generateMoves(it->second.board.sideToMove(), list);
+        c.out += "legal " + id;
+        for (int i=0; i<list.size(); i++)
+          c.out += " " + Protocol::moveText(list[i]);
+        c.out += "\n";
+      }
+      else if (command == "board")
+        c.out += "board " + id + " " + it->second.board.position() + " result " +
+          Protocol::resultText(it->second.board, it->second.history) + " plies " +
+          to_string(it->second.history.size()) + "\n";
+      else if (command == "go")
+        go(fd, c, id, it->second, args);
+      else
+      {
+        games.erase(it);
+        c.out += "ok " + id + "\n";
+      }
+    }
+  }
+  catch (const char* message)
+  {
+    bool global = id.empty() || message == string("Unrecognized command");
+    c.out += "error " + (global ? "" : id + " ") + message + "\n";
+  }
+}
+
+void Server::go(int fd, Connection& c, const string& id, Game& game, const vector<string>& args)
+{
+  SearchLimits limits = Protocol::parseLimits(args, 2);
+  game.searching = true;
+  c.searching++;
+  Board board = game.board;
+  PositionHistory history = game.history;
+  uint64_t serial = c.serial;
+  pool.submit(searches, [this, fd, serial, id, board, history, limits]() {
+    Search* search = searchers.take();
+    SearchResult r = search->run(board, limits, history);
+    searchers.give(search);
+
+    Finished f;
+    f.fd = fd;
+    f.serial = serial;
+    f.id = id;
+    f.reply = "bestmove " + id + " " + (r.hasMove ? Protocol::moveText(r.bestMove) : string("none")) +
+      " score " + to_string(r.score) + " depth " + to_string(r.depth) +
+      " nodes " + to_string(r.nodes) + " ms " + to_string(r.milliseconds) + "\n";
+    {
+      lock_guard<mutex> hold(finishedLock);
+      finished.push_back(f);
+    }
+    uint64_t one = 1;
+    if (write(wake, &one, sizeof(one)) < 0) { }
+  });
+}
+
+ServerClient::ServerClient(const string& unixPath)
+{
+  sockaddr_un address = sockaddr_un();
+  address.sun_family = AF_UNIX;
+  if (unixPath.size() >= sizeof(address.sun_path))
+    throw "Socket path too long";
+  strcpy(address.sun_path, unixPath.c_str());
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) < 0)
+  {
+    if (fd >= 0)
+      ::close(fd);
+    throw "Unable to connect to the Unix socket";
+  }
+}
+ServerClient::ServerClient(int tcpPort)
+{
+  sockaddr_in address = sockaddr_in();
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons((uint16_t)tcpPort);
+  fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) < 0)
+  {
+    if (fd >= 0)
+      ::close(fd);
+    throw "Unable to connect to the TCP port";
+  }
+  int yes = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+}
+ServerClient::~ServerClient()
+{
+  ::close(fd);
+}
+
+void ServerClient::send(const string& line)
+{
+  string text = line + "\n";
+  size_t sent = 0;
+  while (sent < text.size())
+  {
+    ssize_t n = write(fd, text.data() + sent, text.size() - sent);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      throw "Lost the connection to the server";
+    sent += (size_t)n;
+  }
+}
+
+void ServerClient::finish()
+{
+  shutdown(fd, SHUT_WR);
+}
+
+string ServerClient::receive()
+{
+  for (;;)
+  {
+    size_t end = buffer.find('\n');
+    if (end != string::npos)
+    {
+      string line = buffer.substr(0, end);
+      buffer.erase(0, end + 1);
+      return line;
+    }
+    char chunk[4096];
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      throw "Lost the connection to the server";
+    buffer.append(chunk, (size_t)n);
+  }
+}
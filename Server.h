@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+#include "PositionHistory.h"
+#include "Search.h"
+#include "ThreadPool.h"
+
+/*
+ * Server keeps many live games in one process and takes commands for
+ * them over Unix-domain or loopback TCP sockets. One thread runs an
+ * epoll loop over every socket, non-blocking; engine searches are
+ * handed to a ThreadPool, and their results come back to the loop
+ * through an eventfd, so a long search never holds up anybody's moves.
+ *
+ * Commands and replies are the Protocol ones (see Protocol.h), a line
+ * each: position, moves, legal, board, go, close and sessions, plus
+ *   stats    -> stats connections <n> games <n> moves <n> searches <n>
+ *            (connections open now; moves and searches since the start)
+ *   isready  -> readyok (at once; searches are not waited for)
+ *   quit     close this connection, once its searches have answered
+ * A client that shuts down its side of the connection still gets the
+ * replies to the lines it sent before, bestmoves included, and then
+ * the close.
+ * Games belong to the server rather than to a connection, so two
+ * clients, say a person and a bot, can play the same game id. A game
+ * that is searching refuses other commands ("error <id> Searching")
+ * until its bestmove has been sent; there is no undo or stop.
+ *
+ * A game is a Board (32 bytes), its PositionHistory (four bytes
+ * a ply) and a little bookkeeping, so thousands fit in a few MB.
+ */
+class Server
+{
+public:
+  Server(ThreadPool& pool, int hashMegabytes);
+  ~Server();
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+public:
+  void listenUnix(const string& path);
+  void listenTcp(int port); // on 127.0.0.1; 0 picks a free port
+  int tcpPort() const { return port; }
+
+  void run(); // until stop()
+  void stop(); // from any thread
+
+  void setEvaluation(const Evaluation& e) { searchers.setEvaluation(e); }
+
+private:
+  struct Game
+  {
+  public:
+    Board board;
+    PositionHistory history; // one position a ply played
+    bool searching;
+
+  public:
+    Game() : searching(false) { }
+  };
+
+  struct Connection
+  {
+  public:
+    uint64_t serial; // fds are reused, serials aren't
+    string in;
+    string out;
+    bool writing; // waiting for EPOLLOUT
+    bool closing; // once out is written and no search is owed
+    int searching; // searches whose bestmove it is still owed
+  };
+
+  struct Finished
+  {
+  public:
+    int fd;
+    uint64_t serial;
+    string id;
+    string reply;
+  };
+
+  void listenOn(int fd);
+  void accept(int listener);
+  void receive(int fd);
+  void send(int fd);
+  void close(int fd);
+  void watch(int fd, bool writing);
+  void deliver();
+  void handle(int fd, Connection& c, const string& line);
+  void go(int fd, Connection& c, const string& id, Game& game, const vector<string>& args);
+
+private:
+  ThreadPool& pool;
+  SearcherPool searchers;
+  ThreadPool::TaskGroup searches;
+  int epoll;
+  int wake; // eventfd the workers and stop() signal
+  vector<int> listeners;
+  string unixPath;
+  int port;
+  atomic<bool> stopping;
+
+  unordered_map<int, Connection> connections;
+  uint64_t serials;
+  unordered_map<string, Game> games;
+  uint64_t moves; // played since the start
+  uint64_t searched; // searches finished since the start
+
+  mutex finishedLock;
+  vector<Finished> finished;
+};
+
+/*
+ * ServerClient is the other end: a blocking connection that sends
+ * command lines and reads reply lines, for tools and tests
+ */
+class ServerClient
+{
+public:
+  ServerClient(const string& unixPath);
+  ServerClient(int tcpPort);
+  ~ServerClient();
+
+  ServerClient(const ServerClient&) = delete;
+  ServerClient& operator=(const ServerClient&) = delete;
+
+public:
+  void send(const string& line);
+  void finish(); // send nothing more; replies can still be received
+  string receive(); // the next line, without its newline
+
+private:
+  int fd;
+  string buffer;
+};
@@ -0,0 +1,564 @@
+#include "Tablebase.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * File layout: this header; then, for every 512 position indexes, a
+ * block of nine words: the number of representatives before the
+ * block, and a bitmap of which of its indexes are representatives;
+ * then one value byte per representative, in index order
+ */
+struct TablebaseHeader
+{
+  char magic[4]; // "CCTB"
+  uint32_t version;
+  uint32_t rules;
+  uint32_t signature;
+  uint64_t count; // position indexes
+  uint64_t stored; // representatives, and so value bytes
+};
+static const uint32_t FILE_VERSION = 2;
+static const int BLOCK_POSITIONS = 512;
+static const int BLOCK_WORDS = 1 + BLOCK_POSITIONS / 64;
+
+// Binomial coefficients for the combinatorial ranking
+static uint64_t CHOOSE[Board::SQUARES + 1][Board::SQUARES + 1];
+static bool initChoose()
+{
+  for (int n=0; n<=Board::SQUARES; n++)
+  {
+    CHOOSE[n][0] = 1;
+    for (int k=1; k<=n; k++)
+      CHOOSE[n][k] = CHOOSE[n-1][k-1] + (k <= n - 1 ? CHOOSE[n-1][k] : 0);
+  }
+  return true;
+}
+static bool chooseReady = initChoose();
+
+// Rank of a set of squares among the free squares: sum of C(i-th
+// square's position among the free ones, i)
+static uint64_t rankSquares(uint32_t squares, uint32_t free)
+{
+  uint64_t rank = 0;
+  int i = 0;
+  for (uint32_t m = squares; m; m &= m - 1)
+  {
+    int square = __builtin_ctz(m);
+    int position = __builtin_popcount(free & ((1u << square) - 1));
+    rank += CHOOSE[position][++i];
+  }
+  return rank;
+}
+static uint32_t unrankSquares(uint64_t rank, int count, uint32_t free)
+{
+  uint32_t squares = 0;
+  int limit = __builtin_popcount(free);
+  for (int i=count; i>=1; i--)
+  {
+    int position = i - 1;
+    while (position + 1 < limit && CHOOSE[position + 1][i] <= rank)
+      position++;
+    rank -= CHOOSE[position][i];
+    limit = position;
+
+    uint32_t m = free;
+    for (int skip=0; skip<position; skip++)
+      m &= m - 1;
+    squares |= m & (~m + 1);
+  }
+  return squares;
+}
+
+Tablebase::Signature Tablebase::Signature::of(const Board& board)
+{
+  uint32_t kings = board.kingMask();
+  Signature sig;
+  sig.counts[0] = __builtin_popcount(board.playerMask(1) & ~kings);
+  sig.counts[1] = __builtin_popcount(board.playerMask(1) & kings);
+  sig.counts[2] = __builtin_popcount(board.playerMask(2) & ~kings);
+  sig.counts[3] = __builtin_popcount(board.playerMask(2) & kings);
+  return sig;
+}
+
+uint64_t Tablebase::Signature::positions() const
+{
+  uint64_t n = 1;
+  int free = Board::SQUARES;
+  for (int i=0; i<4; i++)
+  {
+    n *= CHOOSE[free][counts[i]];
+    free -= counts[i];
+  }
+  return n;
+}
+
+string Tablebase::Signature::name() const
+{
+  return "x" + to_string(counts[0]) + "X" + to_string(counts[1]) +
+    "o" + to_string(counts[2]) + "O" + to_string(counts[3]);
+}
+
+uint64_t Tablebase::index(const Board& board, const Signature& sig)
+{
+  uint32_t kings = board.kingMask();
+  uint32_t classes[4] = {
+    board.playerMask(1) & ~kings, board.playerMask(1) & kings,
+    board.playerMask(2) & ~kings, board.playerMask(2) & kings
+  };
+
+  uint64_t index = 0;
+  uint32_t free = 0xFFFFFFFFu;
+  int freeCount = Board::SQUARES;
+  for (int i=0; i<4; i++)
+  {
+    index = index * CHOOSE[freeCount][sig.counts[i]] + rankSquares(classes[i], free);
+    free &= ~classes[i];
+    freeCount -= sig.counts[i];
+  }
+  return (board.sideToMove() == 2 ? sig.positions() : 0) + index;
+}
+
+void Tablebase::setup(Board& board, const Signature& sig, uint64_t index)
+{
+  uint64_t per = sig.positions();
+  int side = (index >= per) ? 2 : 1;
+  index %= per;
+
+  // Peel the mixed-radix digits off from the last class back
+  uint64_t radix[4];
+  int freeCount = Board::SQUARES;
+  for (int i=0; i<4; i++)
+  {
+    radix[i] = CHOOSE[freeCount][sig.counts[i]];
+    freeCount -= sig.counts[i];
+  }
+  uint64_t ranks[4];
+  for (int i=3; i>=0; i--)
+  {
+    ranks[i] = index % radix[i];
+    index /= radix[i];
+  }
+
+  uint32_t classes[4];
+  uint32_t free = 0xFFFFFFFFu;
+  for (int i=0; i<4; i++)
+  {
+    classes[i] = unrankSquares(ranks[i], sig.counts[i], free);
+    free &= ~classes[i];
+  }
+  board.setMasks(classes[0] | classes[1], classes[2] | classes[3],
+    classes[1] | classes[3], side);
+}
+
+uint8_t Tablebase::encode(Outcome outcome, int plies)
+{
+  // 0: draw, 1-127: win in that many plies, 128-255: loss in (value - 128)
+  if (outcome == DRAW)
+    return 0;
+  if (plies > 127)
+    throw "Tablebase distance overflow";
+  return (uint8_t)(outcome == WIN ? plies : 128 + plies);
+}
+
+Tablebase::Result Tablebase::decode(uint8_t value)
+{
+  Result r;
+  if (value == 0)
+  {
+    r.outcome = DRAW;
+    r.plies = 0;
+  }
+  else if (value < 128)
+  {
+    r.outcome = WIN;
+    r.plies = value;
+  }
+  else
+  {
+    r.outcome = LOSS;
+    r.plies = value - 128;
+  }
+  return r;
+}
+
+Tablebase::Tablebase(const string& dir)
+  : directory(dir), largest(0)
+{
+  DIR* d = opendir(directory.c_str());
+  if (d == nullptr)
+    return;
+
+  struct dirent* entry;
+  while ((entry = readdir(d)) != nullptr)
+  {
+    string name = entry->d_name;
+    if (name.size() > 5 && name.substr(name.size() - 5) == ".cctb")
+      open(directory + "/" + name);
+  }
+  closedir(d);
+}
+
+Tablebase::~Tablebase()
+{
+  for (auto it = files.begin(); it != files.end(); ++it)
+    munmap(it->second.base, it->second.length);
+}
+
+bool Tablebase::open(const string& path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TablebaseHeader))
+  {
+    close(fd);
+    return false;
+  }
+
+  void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return false;
+
+  const TablebaseHeader* header = (const TablebaseHeader*)base;
+  uint64_t blocks = (header->count + BLOCK_POSITIONS - 1) / BLOCK_POSITIONS;
+  if (memcmp(header->magic, "CCTB", 4) != 0 || header->version != FILE_VERSION ||
+      header->rules != RULES_VERSION ||
+      sizeof(TablebaseHeader) + blocks * BLOCK_WORDS * 8 + header->stored > (size_t)st.st_size)
+  {
+    munmap(base, st.st_size);
+    return false;
+  }
+
+  int key = (int)header->signature;
+  if (files.count(key))
+    munmap(files[key].base, files[key].length);
+
+  Mapping m;
+  m.blocks = (const uint64_t*)((const uint8_t*)base + sizeof(TablebaseHeader));
+  m.values = (const uint8_t*)(m.blocks + blocks * BLOCK_WORDS);
+  m.count = header->count;
+  m.stored = header->stored;
+  m.base = base;
+  m.length = st.st_size;
+  files[key] = m;
+
+  Signature sig;
+  for (int i=0; i<4; i++)
+    sig.counts[i] = (key >> (4 * i)) & 0xF;
+  largest = max(largest, sig.pieces());
+  return true;
+}
+
+bool Tablebase::probe(const Board& board, Result& result) const
+{
+  // Only the normal two-player game is tabulated
+  if (board.playerMask(0) != 0 ||
+      board.getPlayerDirection(1) != Board::Direction::A_TO_H ||
+      board.getPlayerDirection(2) != Board::Direction::H_TO_A ||
+      (board.sideToMove() != 1 && board.sideToMove() != 2))
+    return false;
+
+  Signature sig = Signature::of(board);
+  if (sig.pieces() > largest)
+    return false;
+  auto it = files.find(sig.key());
+  if (it == files.end())
+    return false;
+
+  // Only representatives are stored; their rank among the
+  // representatives is where the value is
+  Board canonical = board;
+  canonical.canonicalize();
+  uint64_t i = index(canonical, sig);
+  const Mapping& m = it->second;
+  if (i >= m.count)
+    return false;
+  const uint64_t* block = m.blocks + (i / BLOCK_POSITIONS) * BLOCK_WORDS;
+  int word = (int)(i % BLOCK_POSITIONS) / 64;
+  uint64_t bit = 1ull << (i % 64);
+  if ((block[1 + word] & bit) == 0)
+    return false;
+  uint64_t rank = block[0];
+  for (int w=0; w<word; w++)
+    rank += __builtin_popcountll(block[1 + w]);
+  rank += __builtin_popcountll(block[1 + word] & (bit - 1));
+  if (rank >= m.stored)
+    return false;
+  result = decode(m.values[rank]);
+  return true;
+}
+
+void Tablebase::generate(const string& directory, int maxPieces, ostream* log)
+{
+  mkdir(directory.c_str(), 0755);
+
+  // Smaller material first; within the same number of pieces, fewer
+  // pawns first, since promotions turn pawns into kings
+  vector<Signature> order;
+  for (int n=1; n<=maxPieces; n++)
+  {
+    for (int pawns=0; pawns<=n; pawns++)
+    {
+      for (int a=0; a<=pawns; a++)
+      {
+        for (int b=0; b<=n-pawns; b++)
+        {
+          Signature sig;
+          sig.counts[0] = a;
+          sig.counts[1] = b;
+          sig.counts[2] = pawns - a;
+          sig.counts[3] = n - pawns - b;
+          order.push_back(sig);
+        }
+      }
+    }
+  }
+
+  Tablebase solved(directory);
+  for (size_t i=0; i<order.size(); i++)
+    solve(directory, order[i], solved, log);
+}
+
+void Tablebase::predecessors(const Board& board, const Signature& sig, vector<uint64_t>& out)
+{
+  // The side that just moved steps a piece back to an empty diagonal
+  // neighbour; captures and promotions come from other tables. The
+  // generator then has to agree that the step was legal there (pawn
+  // direction, compulsory captures) and lands on this very position
+  out.clear();
+  int mover = Board::opponent(board.sideToMove());
+  uint32_t occupied = board.occupiedMask();
+  Board::MoveList list;
+  for (uint32_t m = board.playerMask(mover); m; m &= m - 1)
+  {
+    int to = __builtin_ctz(m);
+    Board::Coord c = Board::coordOf(to);
+    Board::Coord around[4] = { c.upperRight(), c.upperLeft(), c.lowerRight(), c.lowerLeft() };
+    for (int d=0; d<4; d++)
+    {
+      int from = Board::squareOf(around[d]);
+      if (from == Board::NO_SQUARE || (occupied & (1u << from)) != 0)
+        continue;
+
+      uint32_t moved = (1u << from) | (1u << to);
+      uint32_t player1 = board.playerMask(1) ^ (mover == 1 ? moved : 0);
+      uint32_t player2 = board.playerMask(2) ^ (mover == 2 ? moved : 0);
+      uint32_t kings = board.kingMask() ^ ((board.kingMask() & (1u << to)) ? moved : 0);
+      Board previous;
+      previous.setMasks(player1, player2, kings, mover);
+      previous.generateMoves(mover, list);
+      for (int i=0; i<list.size(); i++)
+      {
+        if (list[i].isJump() || list[i].from() != from || list[i].to() != to)
+          continue;
+        Board after = previous;
+        after.makeMove(list[i]);
+        if (after.playerMask(1) == board.playerMask(1) && after.playerMask(2) == board.playerMask(2) &&
+            after.kingMask() == board.kingMask())
+        {
+          previous.canonicalize();
+          out.push_back(index(previous, sig));
+        }
+        break;
+      }
+    }
+  }
+}
+
+void Tablebase::solve(const string& directory, const Signature& sig,
+  Tablebase& solved, ostream* log)
+{
+  auto start = chrono::steady_clock::now();
+  uint64_t total = 2 * sig.positions();
+  vector<uint8_t> values(total, 0); // 0 doubles as "not settled yet"
+
+  // Only representatives are solved; other images look theirs up
+  Board board;
+  vector<uint64_t> canonical((total + 63) / 64, 0);
+  uint64_t stored = 0;
+  for (uint64_t idx=0; idx<total; idx++)
+  {
+    setup(board, sig, idx);
+    if (board.symmetry() == 0)
+    {
+      canonical[idx / 64] |= 1ull << (idx % 64);
+      stored++;
+    }
+  }
+
+  // One forward look at every position settles what doesn't depend on
+  // this table: no move is a loss, and moves that capture or promote
+  // go to smaller tables. outside[] keeps the longest win those moves
+  // give the opponent, or MIXED if one of them doesn't give the
+  // opponent a win, which rules out losing
+  const uint8_t MIXED = 255;
+  vector<uint8_t> outside(total, 0);
+  vector<vector<pair<uint64_t, uint8_t> > > pending; // by distance: index and value
+  auto schedule = [&pending](int plies, uint64_t idx, uint8_t value) {
+    if ((size_t)plies >= pending.size())
+      pending.resize(plies + 1);
+    pending[plies].push_back(make_pair(idx, value));
+  };
+
+  Board::MoveList list;
+  for (uint64_t idx=0; idx<total; idx++)
+  {
+    if ((canonical[idx / 64] & (1ull << (idx % 64))) == 0)
+      continue;
+
+    setup(board, sig, idx);
+    board.generateMoves(board.sideToMove(), list);
+    if (list.empty())
+    {
+      schedule(0, idx, encode(LOSS, 0));
+      continue;
+    }
+
+    bool inside = false;
+    bool mixed = false;
+    int quickest = -1;
+    int longest = 0;
+    for (int i=0; i<list.size(); i++)
+    {
+      Board::Undo undo = board.makeMove(list[i]);
+      Result child;
+      if (Signature::of(board).key() == sig.key())
+        inside = true;
+      else if (!solved.probe(board, child))
+        throw "Missing smaller tablebase";
+      else if (child.outcome == LOSS)
+        quickest = quickest < 0 ? child.plies + 1 : min(quickest, child.plies + 1);
+      else if (child.outcome == WIN)
+        longest = max(longest, child.plies);
+      else
+        mixed = true;
+      board.unmakeMove(list[i], undo);
+    }
+    outside[idx] = (mixed || quickest >= 0) ? MIXED : (uint8_t)longest;
+    if (quickest >= 0)
+      schedule(quickest, idx, encode(WIN, quickest));
+    else if (!inside && !mixed)
+      schedule(longest + 1, idx, encode(LOSS, longest + 1));
+  }
+
+  // Then retrograde: settle positions in order of distance, and from
+  // each one step back to the positions with a move to it. A loss in n
+  // makes them wins in n + 1; a win in n makes one a loss once all its
+  // moves are known wins for the opponent. Whatever is never settled
+  // is a draw
+  int levels = 0;
+  vector<uint64_t> before;
+  for (size_t plies=0; plies<pending.size(); plies++)
+  {
+    for (size_t k=0; k<pending[plies].size(); k++)
+    {
+      uint64_t idx = pending[plies][k].first;
+      uint8_t value = pending[plies][k].second;
+      if (values[idx] != 0)
+        continue;
+      values[idx] = value;
+      levels = (int)plies;
+      bool lost = decode(value).outcome == LOSS;
+
+      setup(board, sig, idx);
+      predecessors(board, sig, before);
+      for (size_t j=0; j<before.size(); j++)
+      {
+        uint64_t p = before[j];
+        if (values[p] != 0)
+          continue;
+        if (lost)
+        {
+          schedule((int)plies + 1, p, encode(WIN, (int)plies + 1));
+          continue;
+        }
+        if (outside[p] == MIXED)
+          continue;
+
+        Board previous;
+        setup(previous, sig, p);
+        previous.generateMoves(previous.sideToMove(), list);
+        bool allWin = true;
+        int longest = outside[p];
+        for (int i=0; i<list.size() && allWin; i++)
+        {
+          Board::Undo undo = previous.makeMove(list[i]);
+          if (Signature::of(previous).key() == sig.key())
+          {
+            Board image = previous;
+            image.canonicalize();
+            uint8_t v = values[index(image, sig)];
+            if (v == 0 || decode(v).outcome != WIN)
+              allWin = false;
+            else
+              longest = max(longest, decode(v).plies);
+          }
+          previous.unmakeMove(list[i], undo);
+        }
+        if (allWin)
+          schedule(longest + 1, p, encode(LOSS, longest + 1));
+      }
+    }
+  }
+
+  string path = directory + "/" + sig.name() + ".cctb";
+  TablebaseHeader header;
+  memcpy(header.magic, "CCTB", 4);
+  header.version = FILE_VERSION;
+  header.rules = RULES_VERSION;
+  header.signature = (uint32_t)sig.key();
+  header.count = total;
+  header.stored = stored;
+
+  vector<uint64_t> blocks;
+  vector<uint8_t> compact;
+  compact.reserve(stored);
+  for (uint64_t first=0; first<total; first+=BLOCK_POSITIONS)
+  {
+    blocks.push_back(compact.size());
+    for (int w=0; w<BLOCK_POSITIONS / 64; w++)
+    {
+      uint64_t word = (first / 64 + w < canonical.size()) ? canonical[first / 64 + w] : 0;
+      blocks.push_back(word);
+      for (uint64_t m = word; m; m &= m - 1)
+        compact.push_back(values[first + w * 64 + __builtin_ctzll(m)]);
+    }
+  }
+
+  // Write beside the old file and rename over it, so processes that
+  // have the old one mapped keep a valid mapping
+  ofstream out(path + ".tmp", ios::binary | ios::trunc);
+  out.write((const char*)&header, sizeof(header));
+  out.write((const char*)blocks.data(), blocks.size() * sizeof(uint64_t));
+  out.write((const char*)compact.data(), compact.size());
+  out.close();
+  if (!out || rename((path + ".tmp").c_str(), path.c_str()) != 0 || !solved.open(path))
+    throw "Unable to write tablebase";
+
+  if (log != nullptr)
+  {
+    uint64_t wins = 0, losses = 0;
+    for (size_t i=0; i<compact.size(); i++)
+    {
+      if (compact[i] != 0 && compact[i] < 128) wins++;
+      if (compact[i] >= 128) losses++;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    (*log) << sig.name() << ": " << total << " positions, " << stored << " stored, "
+      << wins << " wins, " << losses << " losses, " << stored - wins - losses << " draws, "
+      << "longest " << levels << " plies, " << seconds << "s" << endl;
+  }
+}
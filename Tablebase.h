@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+
+/*
+ * Tablebase holds solved endgames: for every position with few enough
+ * pieces, whether the side to move wins, loses or draws, and in how
+ * many plies a win or loss comes (a side with no move loses).
+ *
+ * Positions are grouped by material, a Signature of (player 1 pawns,
+ * player 1 kings, player 2 pawns, player 2 kings). Within a signature a
+ * position's index is the side to move followed by the combinatorial
+ * rank of each piece class's squares among the squares the earlier
+ * classes left free, so every position has exactly one slot and there
+ * is no hashing.
+ *
+ * generate() solves the signatures in order by retrograde analysis.
+ * One forward look at each position finds the ones with no move, and
+ * what captures and promotions into already-solved smaller signatures
+ * give it. Positions are then settled in order of distance, and each
+ * one settled steps back, by un-moving a piece, to the positions with
+ * a move to it: a loss in n makes them wins in n + 1, and a win makes
+ * one a loss once every move it has is a known win for the opponent.
+ * Whatever is never settled is a draw.
+ *
+ * Symmetric positions (Board::symmetry()) are the same game, so only
+ * each one's representative is solved and stored: a bitmap of which
+ * indexes are representatives, with running counts, finds a
+ * representative's byte among the stored ones.
+ *
+ * Each signature is one file of one byte per stored position. A Tablebase maps
+ * every file in its directory with mmap(), so there is no load step and
+ * processes share the pages through the OS cache.
+ *
+ * Tables assume the normal game: players 1 and 2, player 1 moving
+ * A_TO_H. They are tied to the rules that generated them, so the file
+ * header records a rules version.
+ */
+class Tablebase
+{
+public:
+  enum Outcome
+  {
+    DRAW, WIN, LOSS
+  };
+
+  struct Result
+  {
+  public:
+    Outcome outcome;
+    int plies; // to the end of the game, for a WIN or LOSS
+  };
+
+  struct Signature
+  {
+  public:
+    int counts[4]; // player 1 pawns, player 1 kings, player 2 pawns, player 2 kings
+
+  public:
+    static Signature of(const Board& board);
+    int pieces() const { return counts[0] + counts[1] + counts[2] + counts[3]; }
+    int key() const { return counts[0] | counts[1] << 4 | counts[2] << 8 | counts[3] << 12; }
+    uint64_t positions() const; // per side to move
+    string name() const;
+  };
+
+  static const uint32_t RULES_VERSION = 2;
+
+public:
+  Tablebase(const string& directory);
+  ~Tablebase();
+
+  Tablebase(const Tablebase&) = delete;
+  Tablebase& operator=(const Tablebase&) = delete;
+
+public:
+  bool probe(const Board& board, Result& result) const;
+  int maxPieces() const { return largest; }
+  int tables() const { return (int)files.size(); }
+
+  static void generate(const string& directory, int maxPieces, ostream* log);
+
+  static uint64_t index(const Board& board, const Signature& sig);
+  static void setup(Board& board, const Signature& sig, uint64_t index);
+
+private:
+  struct Mapping
+  {
+    const uint64_t* blocks;
+    const uint8_t* values;
+    uint64_t count;
+    uint64_t stored;
+    void* base;
+    size_t length;
+  };
+
+  bool open(const string& path);
+  static uint8_t encode(Outcome outcome, int plies);
+  static Result decode(uint8_t value);
+  static void predecessors(const Board& board, const Signature& sig, vector<uint64_t>& out);
+  static void solve(const string& directory, const Signature& sig, Tablebase& solved, ostream* log);
+
+private:
+  string directory;
+  map<int, Mapping> files;
+  int largest;
+};
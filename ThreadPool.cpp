@@ -0,0 +1,119 @@
+#include "ThreadPool.h"
+
+thread_local int ThreadPool::currentWorker = -1;
+thread_local ThreadPool* ThreadPool::currentPool = nullptr;
+
+ThreadPool::ThreadPool(int threads)
+  : queued(0), stopping(false)
+{
+  if (threads <= 0)
+    threads = hardwareThreads();
+
+  for (int i=0; i<=threads; i++)
+    queues.push_back(unique_ptr<Queue>(new Queue()));
+  for (int i=0; i<threads; i++)
+    workers.push_back(thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    lock_guard<mutex> guard(sleepLock);
+    stopping = true;
+  }
+  wakeup.notify_all();
+  for (size_t i=0; i<workers.size(); i++)
+    workers[i].join();
+}
+
+int ThreadPool::hardwareThreads()
+{
+  unsigned n = thread::hardware_concurrency();
+  return n == 0 ? 1 : (int)n;
+}
+
+void ThreadPool::submit(TaskGroup& group, function<void()> task)
+{
+  group.remaining.fetch_add(1, memory_order_relaxed);
+
+  // Workers keep their own tasks; everyone else shares a queue
+  int index = (currentPool == this) ? currentWorker : size();
+  {
+    lock_guard<mutex> guard(queues[index]->lock);
+    Task t = { task, &group };
+    queues[index]->tasks.push_back(t);
+  }
+  {
+    // Under the sleep lock, so a worker can't miss the wakeup between
+    // checking for work and going to sleep
+    lock_guard<mutex> guard(sleepLock);
+    queued.fetch_add(1, memory_order_release);
+  }
+  wakeup.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup& group)
+{
+  int self = (currentPool == this) ? currentWorker : size();
+  while (!group.done())
+  {
+    if (!runOne(self))
+      this_thread::yield();
+  }
+}
+
+bool ThreadPool::popOwn(int self, Task& task)
+{
+  Queue& q = *queues[self];
+  lock_guard<mutex> guard(q.lock);
+  if (q.tasks.empty())
+    return false;
+  task = q.tasks.back();
+  q.tasks.pop_back();
+  return true;
+}
+
+bool ThreadPool::steal(int self, Task& task)
+{
+  int n = (int)queues.size();
+  for (int i=1; i<=n; i++)
+  {
+    Queue& q = *queues[(self + i) % n];
+    lock_guard<mutex> guard(q.lock);
+    if (!q.tasks.empty())
+    {
+      task = q.tasks.front();
+      q.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::runOne(int self)
+{
+  Task task;
+  if (!popOwn(self, task) && !steal(self, task))
+    return false;
+
+  queued.fetch_sub(1, memory_order_relaxed);
+  task.run();
+  task.group->remaining.fetch_sub(1, memory_order_release);
+  return true;
+}
+
+void ThreadPool::workerLoop(int index)
+{
+  currentWorker = index;
+  currentPool = this;
+  while (!stopping)
+  {
+    if (runOne(index))
+      continue;
+
+    unique_lock<mutex> guard(sleepLock);
+    wakeup.wait(guard, [this]() {
+      return stopping || queued.load(memory_order_acquire) > 0;
+    });
+  }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/*
+ * ThreadPool is a work-stealing task pool. Every worker has its own
+ * deque: it pushes and pops its own tasks at the back (newest first,
+ * which keeps a recursive split depth-first and cache-warm) while idle
+ * workers steal from the front of other deques (oldest first, which
+ * are the biggest pieces of work). Threads that aren't workers submit
+ * into a shared deque that everyone steals from.
+ *
+ * Tasks belong to a TaskGroup. wait() on a group doesn't block: the
+ * waiting thread runs queued tasks until the group is done, so tasks
+ * can split further and wait on their own children without deadlock.
+ */
+class ThreadPool
+{
+public:
+  class TaskGroup
+  {
+  public:
+    TaskGroup() : remaining(0) { }
+    bool done() const { return remaining.load(memory_order_acquire) == 0; }
+
+  private:
+    friend class ThreadPool;
+    atomic<int> remaining;
+  };
+
+public:
+  ThreadPool(int threads = 0); // 0: one per hardware thread
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+public:
+  int size() const { return (int)workers.size(); }
+  static int hardwareThreads();
+
+  void submit(TaskGroup& group, function<void()> task);
+  void wait(TaskGroup& group);
+
+private:
+  struct Task
+  {
+    function<void()> run;
+    TaskGroup* group;
+  };
+  struct Queue
+  {
+    mutex lock;
+    deque<Task> tasks;
+  };
+
+  void workerLoop(int index);
+  bool runOne(int self);
+  bool popOwn(int self, Task& task);
+  bool steal(int self, Task& task);
+
+private:
+  vector<unique_ptr<Queue> > queues; // one per worker, then the shared one
+  vector<thread> workers;
+  atomic<int> queued;
+  atomic<bool> stopping;
+  mutex sleepLock;
+  condition_variable wakeup;
+
+  static thread_local int currentWorker;
+  static thread_local ThreadPool* currentPool;
+};
@@ -0,0 +1,168 @@
+#include "TranspositionTable.h"
+
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
+TranspositionTable::TranspositionTable(size_t megabytes)
+  : buckets(nullptr), bucketCount(0), age(0)
+{
+  resize(megabytes);
+}
+
+TranspositionTable::~TranspositionTable()
+{
+  free(buckets);
+}
+
+void TranspositionTable::resize(size_t megabytes)
+{
+  // Round down to a power of two so a bucket is found with a mask
+  size_t wanted = (megabytes * 1024 * 1024) / sizeof(Bucket);
+  size_t count = 1;
+  while (count * 2 <= wanted)
+    count *= 2;
+
+  // new[] ignores alignas(64) before C++17, which would let buckets
+  // straddle cache lines; allocate aligned and construct in place.
+  // Buckets need no destructor, so free() is enough to release them
+  static_assert(is_trivially_destructible<Bucket>::value, "Buckets are freed without destructors");
+  free(buckets);
+  buckets = nullptr;
+  bucketCount = 0;
+  void* memory = nullptr;
+  if (posix_memalign(&memory, alignof(Bucket), count * sizeof(Bucket)) != 0)
+    throw "Out of memory for the transposition table";
+  buckets = static_cast<Bucket*>(memory);
+  for (size_t b=0; b<count; b++)
+    new (&buckets[b]) Bucket();
+  bucketCount = count;
+  clear();
+}
+
+void TranspositionTable::clear()
+{
+  for (size_t b=0; b<bucketCount; b++)
+  {
+    for (int i=0; i<BUCKET_SIZE; i++)
+    {
+      buckets[b].slots[i].check.store(0, memory_order_relaxed);
+      buckets[b].slots[i].data.store(0, memory_order_relaxed);
+    }
+  }
+  age = 0;
+}
+
+uint64_t TranspositionTable::pack(int depth, Bound bound, int score,
+  Board::Move move, uint64_t age)
+{
+  if (depth < 0) depth = 0;
+  if (depth > 255) depth = 255;
+  return ((uint64_t)(uint16_t)(int16_t)score) |
+    ((uint64_t)depth << 16) |
+    ((uint64_t)bound << 24) |
+    (age << 26) |
+    ((uint64_t)move.bits << 32);
+}
+
+TranspositionTable::Entry TranspositionTable::unpack(uint64_t data)
+{
+  Entry e;
+  e.score = (int16_t)(data & 0xFFFF);
+  e.depth = depthOf(data);
+  e.bound = (Bound)((data >> 24) & 3);
+  e.move.bits = (uint16_t)(data >> 32);
+  return e;
+}
+
+bool TranspositionTable::probe(uint64_t hash, Entry& entry) const
+{
+  const Bucket& bucket = buckets[hash & (bucketCount - 1)];
+  for (int i=0; i<BUCKET_SIZE; i++)
+  {
+    uint64_t data = bucket.slots[i].data.load(memory_order_relaxed);
+    uint64_t check = bucket.slots[i].check.load(memory_order_relaxed);
+    if ((check ^ data) == hash && data != 0)
+    {
+      entry = unpack(data);
+      return entry.bound != NONE;
+    }
+  }
+  return false;
+}
+
+void TranspositionTable::store(uint64_t hash, int depth, Bound bound,
+  int score, Board::Move move)
+{
+  Bucket& bucket = buckets[hash & (bucketCount - 1)];
+
+  // Reuse this position's own slot if it has one, otherwise evict the
+  // slot worth least: shallow entries from old searches go first
+  int victim = 0;
+  int victimWorth = 1 << 30;
+  for (int i=0; i<BUCKET_SIZE; i++)
+  {
+    uint64_t data = bucket.slots[i].data.load(memory_order_relaxed);
+    uint64_t check = bucket.slots[i].check.load(memory_order_relaxed);
+    if ((check ^ data) == hash)
+    {
+      // Don't let a shallow non-exact result clobber a deeper one,
+      // but keep its move if it had none
+      Entry old = unpack(data);
+      if (bound != EXACT && old.depth > depth && ageOf(data) == age)
+        return;
+      if (move.bits == 0)
+        move = old.move;
+      victim = i;
+      break;
+    }
+
+    int staleness = (int)((age - ageOf(data)) & AGE_MASK);
+    int worth = depthOf(data) - 8 * staleness;
+    if (data == 0)
+      worth = -(1 << 30);
+    if (worth < victimWorth)
+    {
+      victim = i;
+      victimWorth = worth;
+    }
+  }
+
+  uint64_t data = pack(depth, bound, score, move, age);
+  bucket.slots[victim].check.store(hash ^ data, memory_order_relaxed);
+  bucket.slots[victim].data.store(data, memory_order_relaxed);
+}
+
+size_t TranspositionTable::bytesUsed() const
+{
+  // Slots written during this search, in a sample of buckets; what
+  // earlier searches left is the table's, not this search's
+  size_t sample = bucketCount < 1024 ? bucketCount : 1024;
+  uint64_t used = 0;
+  for (size_t b=0; b<sample; b++)
+  {
+    for (int i=0; i<BUCKET_SIZE; i++)
+    {
+      uint64_t data = buckets[b].slots[i].data.load(memory_order_relaxed);
+      if (data != 0 && ageOf(data) == age)
+        used++;
+    }
+  }
+  return (size_t)((uint64_t)bytes() * used / (sample * BUCKET_SIZE));
+}
+int TranspositionTable::hashfull() const
+{
+  // Per-mille of a sample of slots written during this search
+  size_t sample = bucketCount < 250 ? bucketCount : 250;
+  int used = 0;
+  for (size_t b=0; b<sample; b++)
+  {
+    for (int i=0; i<BUCKET_SIZE; i++)
+    {
+      uint64_t data = buckets[b].slots[i].data.load(memory_order_relaxed);
+      if (data != 0 && ageOf(data) == age)
+        used++;
+    }
+  }
+  return (int)(used * 1000 / (sample * BUCKET_SIZE));
+}
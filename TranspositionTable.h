@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "Board.h"
+
+/*
+ * TranspositionTable is a fixed-size cache of search results keyed by
+ * Board::hash(), shared by every search thread without locks. Since
+ * that hash is the same for every symmetric image of a position, one
+ * entry serves all of them; callers store moves as played in
+ * the representative (see Board::symmetry()).
+ *
+ * Each entry is two 64-bit words: the packed data, and the position key
+ * XOR-ed with that data. A reader that sees a data word from one writer
+ * and a key word from another gets a key that doesn't match, so a torn
+ * entry just looks like a miss. Entries live in buckets of four (one
+ * cache line); a store replaces the shallowest or oldest entry in the
+ * bucket, so deep results survive.
+ */
+class TranspositionTable
+{
+public:
+  enum Bound
+  {
+    NONE, UPPER, LOWER, EXACT
+  };
+
+  struct Entry
+  {
+  public:
+    int score;
+    int depth;
+    Bound bound;
+    Board::Move move;
+  };
+
+public:
+  TranspositionTable(size_t megabytes);
+  ~TranspositionTable();
+
+  TranspositionTable(const TranspositionTable&) = delete;
+  TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+public:
+  void resize(size_t megabytes);
+  void clear();
+  void newSearch() { age = (age + 1) & AGE_MASK; }
+
+  bool probe(uint64_t hash, Entry& entry) const;
+  void store(uint64_t hash, int depth, Bound bound, int score, Board::Move move);
+
+  size_t entries() const { return bucketCount * BUCKET_SIZE; }
+  size_t bytes() const { return bucketCount * sizeof(Bucket); }
+  size_t bytesUsed() const; // by this search, estimated like hashfull()
+  int hashfull() const;
+
+private:
+  static const int BUCKET_SIZE = 4;
+  static const uint64_t AGE_MASK = 0x3F;
+
+  struct Slot
+  {
+    atomic<uint64_t> check; // hash ^ data
+    atomic<uint64_t> data;
+  };
+  struct alignas(64) Bucket
+  {
+    Slot slots[BUCKET_SIZE];
+  };
+
+  /*
+   * Data word layout:
+   *   bits  0-15  score (signed)
+   *   bits 16-23  depth
+   *   bits 24-25  bound
+   *   bits 26-31  age of the search that stored it
+   *   bits 32-47  move
+   */
+  static uint64_t pack(int depth, Bound bound, int score, Board::Move move, uint64_t age);
+  static Entry unpack(uint64_t data);
+  static int depthOf(uint64_t data) { return (int)((data >> 16) & 0xFF); }
+  static uint64_t ageOf(uint64_t data) { return (data >> 26) & AGE_MASK; }
+
+private:
+  Bucket* buckets;
+  size_t bucketCount;
+  uint64_t age;
+};
@@ -0,0 +1,162 @@
+/*
+ * Analyze: batch search over a list of positions, reporting the best
+ * move, score and search statistics for each
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+#include "Search.h"
+#include "ThreadPool.h"
+#include "TranspositionTable.h"
+
+void usage()
+{
+  cout << "analyze [options] [position ...] : Search each position (default: start position)" << endl;
+  cout << "  -t threads      : Search threads (default 1, 0 for all)" << endl;
+  cout << "  -d depth        : Depth limit (default 10 if no other limit)" << endl;
+  cout << "  -n nodes        : Node limit" << endl;
+  cout << "  -ms milliseconds: Time limit per position" << endl;
+  cout << "  -hash megabytes : Transposition table size (default 64)" << endl;
+  cout << "  -w file         : Load evaluation weights from file" << endl;
+  cout << "  -v              : Print every iteration" << endl;
+  cout << "  -               : Read positions from stdin, one per line" << endl;
+  cout << "  --scaling       : Time the whole batch with 1/2/4/8/all threads" << endl;
+}
+
+string pvString(const SearchResult& r)
+{
+  string retval;
+  for (size_t i=0; i<r.pv.size(); i++)
+    retval += (i > 0 ? " " : "") + Board::moveName(r.pv[i]);
+  return retval;
+}
+
+double runBatch(const vector<Board>& boards, SearchLimits limits, int megabytes,
+  const Evaluation& evaluation, bool print, bool verbose, uint64_t& nodes)
+{
+  TranspositionTable tt(megabytes);
+  ThreadPool pool(limits.threads > 1 ? limits.threads - 1 : 1);
+  Search search(tt);
+  search.setPool(&pool);
+  search.setEvaluation(evaluation);
+  if (verbose)
+    search.setInfo(&cout);
+
+  nodes = 0;
+  auto start = chrono::steady_clock::now();
+  for (size_t i=0; i<boards.size(); i++)
+  {
+    SearchResult r = search.run(boards[i], limits);
+    nodes += r.nodes;
+    if (print)
+    {
+      int ms = r.milliseconds > 0 ? r.milliseconds : 1;
+      cout << boards[i].position() << " bestmove "
+        << (r.hasMove ? Board::moveName(r.bestMove) : "none")
+        << " score " << r.score << " depth " << r.depth << " nodes " << r.nodes
+        << " time " << r.milliseconds << " nps " << r.nodes * 1000 / ms
+        << " memory " << r.memory / 1024 << "k pv " << pvString(r) << endl;
+    }
+  }
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    SearchLimits limits;
+    int megabytes = 64;
+    Evaluation evaluation;
+    bool scale = false;
+    bool verbose = false;
+    vector<Board> boards;
+    for (int i=1; i<argc; i++)
+    {
+      string arg = argv[i];
+      if (arg == "--help" || arg == "-h")
+      {
+        usage();
+        return 0;
+      }
+      else if (arg == "-t" && i + 1 < argc)
+        limits.threads = atoi(argv[++i]);
+      else if (arg == "-d" && i + 1 < argc)
+        limits.depth = atoi(argv[++i]);
+      else if (arg == "-n" && i + 1 < argc)
+        limits.nodes = strtoull(argv[++i], nullptr, 10);
+      else if (arg == "-ms" && i + 1 < argc)
+        limits.milliseconds = atoi(argv[++i]);
+      else if (arg == "-hash" && i + 1 < argc)
+        megabytes = atoi(argv[++i]);
+      else if (arg == "-w" && i + 1 < argc)
+        evaluation.load(argv[++i]);
+      else if (arg == "-v")
+        verbose = true;
+      else if (arg == "--scaling")
+        scale = true;
+      else if (arg == "-")
+      {
+        string line;
+        while (getline(cin, line))
+        {
+          if (line.empty() || line[0] == '#')
+            continue;
+          boards.push_back(Board());
+          boards.back().setPosition(line);
+        }
+      }
+      else
+      {
+        boards.push_back(Board());
+        boards.back().setPosition(arg);
+      }
+    }
+
+    if (boards.empty())
+      boards.push_back(Board());
+    if (limits.depth == 0 && limits.nodes == 0 && limits.milliseconds == 0)
+      limits.depth = 10;
+    if (limits.threads <= 0)
+      limits.threads = ThreadPool::hardwareThreads();
+
+    if (!scale)
+    {
+      uint64_t nodes;
+      double seconds = runBatch(boards, limits, megabytes, evaluation, true, verbose, nodes);
+      cout << "Total: " << nodes << " nodes in " << seconds << "s ("
+        << (uint64_t)(nodes / (seconds > 0 ? seconds : 1)) << " nodes/sec)" << endl;
+      return 0;
+    }
+
+    vector<int> threadCounts = { 1, 2, 4, 8 };
+    int all = ThreadPool::hardwareThreads();
+    if (all != 1 && all != 2 && all != 4 && all != 8)
+      threadCounts.push_back(all);
+
+    double base = 0;
+    for (size_t i=0; i<threadCounts.size(); i++)
+    {
+      limits.threads = threadCounts[i];
+      uint64_t nodes;
+      double seconds = runBatch(boards, limits, megabytes, evaluation, false, false, nodes);
+      if (i == 0)
+        base = seconds;
+      cout << threadCounts[i] << " threads: " << nodes << " nodes in " << seconds << "s ("
+        << (uint64_t)(nodes / (seconds > 0 ? seconds : 1)) << " nodes/sec, speedup "
+        << base / (seconds > 0 ? seconds : 1) << "x)" << endl;
+    }
+  }
+  catch (const char* message)
+  {
+    cout << "*** ERROR: " << message << endl;
+    return 2;
+  }
+  return 0;
+}
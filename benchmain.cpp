@@ -0,0 +1,424 @@
+/*
+ * Bench: times the Board hot paths on a fixed set of positions, so runs
+ * from different commits can be compared
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+#include "Evaluation.h"
+#include "Perft.h"
+#include "PositionBatch.h"
+
+void usage()
+{
+  cout << "bench [options] : Time Board operations (nanoseconds per operation)" << endl;
+  cout << "  -r samples  : Timed samples per benchmark (default 50)" << endl;
+  cout << "  -w samples  : Warm-up samples per benchmark (default 5)" << endl;
+  cout << "  -p file     : Take positions from a perft count file (default perft.txt)" << endl;
+  cout << "  -f filter   : Only run benchmarks whose name contains filter" << endl;
+  cout << "  --csv file  : Also write the results as CSV" << endl;
+  cout << "  --json file : Also write the results as JSON" << endl;
+}
+
+// Results feed this so the compiler can't drop the work being timed
+static volatile uint64_t sink;
+
+struct Benchmark
+{
+public:
+  string name;
+  function<uint64_t()> run; // one sample; returns the operations done
+  function<void()> prepare; // if set, readies scratch state before each sample, untimed
+};
+
+struct Result
+{
+public:
+  string name;
+  uint64_t operations; // per sample
+  double min, p50, p90, p99, mean; // nanoseconds per operation
+};
+
+double percentile(const vector<double>& sorted, double p)
+{
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[min(i, sorted.size() - 1)];
+}
+
+Result measure(const Benchmark& b, int warmup, int samples)
+{
+  uint64_t operations = 0;
+  for (int i=0; i<warmup; i++)
+  {
+    if (b.prepare)
+      b.prepare();
+    operations = b.run();
+  }
+
+  vector<double> times;
+  for (int i=0; i<samples; i++)
+  {
+    if (b.prepare)
+      b.prepare();
+    auto start = chrono::steady_clock::now();
+    operations = b.run();
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    times.push_back(ns / max<uint64_t>(operations, 1));
+  }
+  sort(times.begin(), times.end());
+
+  Result r;
+  r.name = b.name;
+  r.operations = operations;
+  r.min = times.front();
+  r.p50 = percentile(times, 0.50);
+  r.p90 = percentile(times, 0.90);
+  r.p99 = percentile(times, 0.99);
+  double total = 0;
+  for (size_t i=0; i<times.size(); i++)
+    total += times[i];
+  r.mean = total / times.size();
+  return r;
+}
+
+vector<Benchmark> benchmarks(const vector<Board>& boards)
+{
+  // Every legal (from, to) pair in every position, found once up front
+  vector<pair<size_t, pair<Board::Coord, Board::Coord> > > legal;
+  for (size_t b=0; b<boards.size(); b++)
+  {
+    for (int p=1; p<=2; p++)
+    {
+      Board::MoveList list;
+      boards[b].generateMoves(p, list);
+      for (int i=0; i<list.size(); i++)
+        legal.push_back(make_pair(b, make_pair(Board::coordOf(list[i].from()),
+          Board::coordOf(list[i].to()))));
+    }
+  }
+
+  // The positions and everything a move or two from them, as Boards and
+  // as one batch
+  vector<Board> spread;
+  for (size_t b=0; b<boards.size(); b++)
+  {
+    spread.push_back(boards[b]);
+    Board::MoveList first;
+    boards[b].generateMoves(boards[b].sideToMove(), first);
+    for (int i=0; i<first.size(); i++)
+    {
+      Board child = boards[b];
+      child.makeMove(first[i]);
+      spread.push_back(child);
+      Board::MoveList second;
+      child.generateMoves(child.sideToMove(), second);
+      for (int j=0; j<second.size(); j++)
+      {
+        Board grandchild = child;
+        grandchild.makeMove(second[j]);
+        spread.push_back(grandchild);
+      }
+    }
+  }
+  PositionBatch batch;
+  for (size_t i=0; i<spread.size(); i++)
+    batch.add(spread[i]);
+
+  // Boards for the benchmarks that need them non-const or changed, so
+  // that copying them stays out of the timing: a copy of the positions
+  // put back before each sample, and a fresh board for every move
+  const int MOVE_REPS = 20;
+  shared_ptr<vector<Board> > scratch = make_shared<vector<Board> >(boards);
+  auto restore = [=]() { *scratch = boards; };
+  shared_ptr<vector<Board> > fresh = make_shared<vector<Board> >();
+  auto refill = [=]() {
+    fresh->clear();
+    for (int rep=0; rep<MOVE_REPS; rep++)
+      for (size_t i=0; i<legal.size(); i++)
+        fresh->push_back(boards[legal[i].first]);
+  };
+  shared_ptr<PositionBatch> batchScratch = make_shared<PositionBatch>(batch);
+
+  vector<Benchmark> all;
+  all.push_back({ "coord_normalize", [=]() {
+    uint64_t total = 0, n = 0;
+    for (int rep=0; rep<100; rep++)
+      for (char row='a'; row<='h'; row++)
+        for (int col=-15; col<=24; col++, n++)
+          total += Board::Coord(row, col).col;
+    sink = total;
+    return n;
+  } });
+  all.push_back({ "board_construct", [=]() {
+    uint64_t total = 0;
+    for (int i=0; i<2000; i++)
+    {
+      Board b;
+      total += b.hash();
+    }
+    sink = total;
+    return (uint64_t)2000;
+  } });
+  all.push_back({ "board_copy", [=]() {
+    uint64_t total = 0, n = 0;
+    for (int rep=0; rep<2000; rep++)
+      for (size_t i=0; i<boards.size(); i++, n++)
+      {
+        Board copy = boards[i];
+        total += copy.hash();
+      }
+    sink = total;
+    return n;
+  } });
+  all.push_back({ "get", [=]() {
+    vector<Board>& b = *scratch;
+    uint64_t total = 0, n = 0;
+    for (int rep=0; rep<50; rep++)
+      for (size_t i=0; i<b.size(); i++)
+        for (char row='a'; row<='h'; row++)
+          for (int col=1; col<=8; col++, n++)
+            total += b[i].get(Board::Coord(row, col)).player;
+    sink = total;
+    return n;
+  }, restore });
+  all.push_back({ "set", [=]() {
+    vector<Board>& b = *scratch;
+    uint64_t n = 0;
+    for (int rep=0; rep<50; rep++)
+      for (size_t i=0; i<b.size(); i++)
+        for (int sq=0; sq<Board::SQUARES; sq++, n += 2)
+        {
+          Board::Coord c = Board::coordOf(sq);
+          Piece before = b[i].get(c);
+          b[i].set(Piece(1 + (sq & 1), (sq >> 1) & 1), c);
+          b[i].set(before, c);
+        }
+    sink = b[0].hash();
+    return n;
+  }, restore });
+  all.push_back({ "legalMove", [=]() {
+    vector<Board>& b = *scratch;
+    uint64_t total = 0, n = 0;
+    for (int rep=0; rep<10; rep++)
+      for (size_t i=0; i<b.size(); i++)
+        for (int from=0; from<Board::SQUARES; from++)
+          for (int to=0; to<Board::SQUARES; to++, n++)
+            total += b[i].legalMove(Board::coordOf(from), Board::coordOf(to));
+    sink = total;
+    return n;
+  }, restore });
+  all.push_back({ "legalMove_squares", [=]() {
+    uint64_t total = 0, n = 0;
+    Board::Move m;
+    for (int rep=0; rep<10; rep++)
+      for (size_t i=0; i<boards.size(); i++)
+        for (int from=0; from<Board::SQUARES; from++)
+          for (int to=0; to<Board::SQUARES; to++, n++)
+            total += boards[i].legalMove(from, to, m);
+    sink = total;
+    return n;
+  } });
+  all.push_back({ "move", [=]() {
+    vector<Board>& b = *fresh;
+    uint64_t total = 0, n = 0;
+    for (int rep=0; rep<MOVE_REPS; rep++)
+      for (size_t i=0; i<legal.size(); i++, n++)
+        total += b[n].move(legal[i].second.first, legal[i].second.second);
+    sink = total;
+    return n;
+  }, refill });
+  all.push_back({ "generateMoves", [=]() {
+    uint64_t total = 0, n = 0;
+    Board::MoveList list;
+    for (int rep=0; rep<1000; rep++)
+      for (size_t i=0; i<boards.size(); i++, n++)
+      {
+        boards[i].generateMoves(boards[i].sideToMove(), list);
+        total += list.size();
+      }
+    sink = total;
+    return n;
+  } });
+  all.push_back({ "makeMove_unmakeMove", [=]() {
+    vector<Board>& b = *scratch;
+    uint64_t total = 0, n = 0;
+    Board::MoveList list;
+    for (size_t i=0; i<b.size(); i++)
+    {
+      b[i].generateMoves(b[i].sideToMove(), list);
+      for (int rep=0; rep<500; rep++)
+        for (int m=0; m<list.size(); m++, n++)
+        {
+          Board::Undo undo = b[i].makeMove(list[m]);
+          total += b[i].hash();
+          b[i].unmakeMove(list[m], undo);
+        }
+    }
+    sink = total;
+    return n;
+  }, restore });
+  all.push_back({ "evaluate_boards", [=]() {
+    Evaluation evaluation;
+    uint64_t total = 0, n = 0;
+    for (int rep=0; rep<20; rep++)
+      for (size_t i=0; i<spread.size(); i++, n++)
+        total += evaluation.score(spread[i]);
+    sink = total;
+    return n;
+  } });
+  all.push_back({ "evaluate_batch_scalar", [=]() {
+    PositionBatch& batched = *batchScratch;
+    uint64_t total = 0, n = 0;
+    for (int rep=0; rep<20; rep++, n += batched.size())
+    {
+      batched.computeFeaturesScalar();
+      total += batched.features[0][PositionBatch::MOBILITY][0];
+    }
+    sink = total;
+    return n;
+  } });
+  if (PositionBatch::hasAvx2())
+    all.push_back({ "evaluate_batch_avx2", [=]() {
+      PositionBatch& batched = *batchScratch;
+      uint64_t total = 0, n = 0;
+      for (int rep=0; rep<20; rep++, n += batched.size())
+      {
+        batched.computeFeaturesAvx2();
+        total += batched.features[0][PositionBatch::MOBILITY][0];
+      }
+      sink = total;
+      return n;
+    } });
+  all.push_back({ "evaluate_batch", [=]() {
+    Evaluation evaluation;
+    PositionBatch& batched = *batchScratch;
+    vector<int> scores;
+    uint64_t total = 0, n = 0;
+    for (int rep=0; rep<20; rep++, n += batched.size())
+    {
+      evaluation.score(batched, scores);
+      total += scores[0];
+    }
+    sink = total;
+    return n;
+  } });
+  all.push_back({ "dump", [=]() {
+    vector<Board>& b = *scratch;
+    uint64_t total = 0, n = 0;
+    for (int rep=0; rep<20; rep++)
+      for (size_t i=0; i<b.size(); i++, n++)
+        total += b[i].dump().size();
+    sink = total;
+    return n;
+  }, restore });
+  return all;
+}
+
+int main(int argc, char* argv[])
+{
+  int samples = 50;
+  int warmup = 5;
+  string positions = "perft.txt";
+  string filter, csvFile, jsonFile;
+  for (int i=1; i<argc; i++)
+  {
+    string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      usage();
+      return 0;
+    }
+    else if (arg == "-r" && i + 1 < argc)
+      samples = max(1, atoi(argv[++i]));
+    else if (arg == "-w" && i + 1 < argc)
+      warmup = max(0, atoi(argv[++i]));
+    else if (arg == "-p" && i + 1 < argc)
+      positions = argv[++i];
+    else if (arg == "-f" && i + 1 < argc)
+      filter = argv[++i];
+    else if (arg == "--csv" && i + 1 < argc)
+      csvFile = argv[++i];
+    else if (arg == "--json" && i + 1 < argc)
+      jsonFile = argv[++i];
+    else
+    {
+      usage();
+      return 2;
+    }
+  }
+
+  try
+  {
+    // The distinct positions of the perft file, in order
+    vector<Board> boards;
+    vector<string> seen;
+    vector<Perft::Count> counts = Perft::load(positions);
+    for (size_t i=0; i<counts.size(); i++)
+    {
+      if (find(seen.begin(), seen.end(), counts[i].position) != seen.end())
+        continue;
+      seen.push_back(counts[i].position);
+      boards.push_back(Board());
+      boards.back().setPosition(counts[i].position);
+    }
+    if (boards.empty())
+      boards.push_back(Board());
+
+    cout << boards.size() << " positions, " << warmup << " warm-up and " << samples
+      << " timed samples; nanoseconds per operation" << endl;
+    cout << left << setw(22) << "benchmark" << right << setw(10) << "min" << setw(10) << "p50"
+      << setw(10) << "p90" << setw(10) << "p99" << setw(10) << "mean" << endl;
+
+    vector<Result> results;
+    vector<Benchmark> all = benchmarks(boards);
+    for (size_t i=0; i<all.size(); i++)
+    {
+      if (!filter.empty() && all[i].name.find(filter) == string::npos)
+        continue;
+      Result r = measure(all[i], warmup, samples);
+      results.push_back(r);
+      cout << left << setw(22) << r.name << right << fixed << setprecision(2)
+        << setw(10) << r.min << setw(10) << r.p50 << setw(10) << r.p90
+        << setw(10) << r.p99 << setw(10) << r.mean << endl;
+    }
+
+    if (!csvFile.empty())
+    {
+      ofstream csv(csvFile);
+      csv << "benchmark,operations,min_ns,p50_ns,p90_ns,p99_ns,mean_ns" << endl;
+      for (size_t i=0; i<results.size(); i++)
+        csv << results[i].name << "," << results[i].operations << "," << results[i].min << ","
+          << results[i].p50 << "," << results[i].p90 << "," << results[i].p99 << ","
+          << results[i].mean << endl;
+    }
+    if (!jsonFile.empty())
+    {
+      ofstream json(jsonFile);
+      json << "{\"positions\": " << boards.size() << ", \"samples\": " << samples
+        << ", \"warmup\": " << warmup << ", \"results\": [" << endl;
+      for (size_t i=0; i<results.size(); i++)
+        json << "  {\"name\": \"" << results[i].name << "\", \"operations\": " << results[i].operations
+          << ", \"min_ns\": " << results[i].min << ", \"p50_ns\": " << results[i].p50
+          << ", \"p90_ns\": " << results[i].p90 << ", \"p99_ns\": " << results[i].p99
+          << ", \"mean_ns\": " << results[i].mean << "}" << (i + 1 < results.size() ? "," : "") << endl;
+      json << "]}" << endl;
+    }
+  }
+  catch (const char* message)
+  {
+    cout << "*** ERROR: " << message << endl;
+    return 2;
+  }
+  return 0;
+}
@@ -6,9 +6,21 @@
 #include <tuple>
 #include <fstream>
 #include <iostream>
+#include <utility>
+#include <vector>
 using namespace std;
 
 #include "Board.h"
+#include "Evaluation.h"
+#include "GameRecord.h"
+#include "Ponder.h"
+#include "PositionHistory.h"
+#include "Search.h"
+#include "Tablebase.h"
+#include "TranspositionTable.h"
+
+// How long the computer thinks about each of its moves
+const int COMPUTER_MOVE_MS = 1000;
 
 string getPlayerInput()
 {
@@ -22,8 +34,15 @@ void help()
 {
   cout << "QUIT|quit|q   : Terminate the game" << endl;
   cout << "HELP|help|h   : Show this help" << endl;
+  cout << "UNDO|undo|u   : Take back the last move" << endl;
+  cout << "GO|go|g       : Let the computer make the next move" << endl;
+  cout << "COMPUTER|computer|c : Let the computer answer every move (again to stop)" << endl;
+  cout << "PONDER|ponder : Let the computer think on your time (again to stop)" << endl;
+  cout << "TB|tb         : Look the position up in the endgame tablebase" << endl;
+  cout << "EVAL|eval     : Show the static evaluation of the position" << endl;
   cout << "Moves take the form of coordinate,coordinate pairs, such as c1,d2" << endl;
   cout << "To trace moves to a file, put filename on the command-line arguments" << endl;
+  cout << "(a filename ending in .ccgr records the game as a binary game archive)" << endl;
 }
 
 tuple<bool, Board::Coord, Board::Coord> parseCoords(const string& input)
@@ -45,23 +64,85 @@ tuple<bool, Board::Coord, Board::Coord> parseCoords(const string& input)
   return make_tuple(false, Board::Coord(-1, -1), Board::Coord(-1,-1));
 }
 
+void playMove(Board& board, vector<pair<Board::Move, Board::Undo> >& history,
+  PositionHistory& positions, ofstream* tracefile, const Board::Move& m)
+{
+  Board::Coord from = Board::coordOf(m.from());
+  Board::Coord to = Board::coordOf(m.to());
+  positions.push(board);
+  history.push_back(make_pair(m, board.makeMove(m)));
+  if (tracefile != nullptr)
+    (*tracefile) << "board.move(Board::" << ((char)(from.row - 32)) << from.col
+      << ",Board::" << ((char)(to.row - 32)) << to.col << ");" << endl;
+}
+
+// With a ponder, the reply it was searching is used if the last move
+// was the one it predicted, and the reply the computer expects to its
+// own move is pondered while the player thinks
+bool computerMove(Board& board, vector<pair<Board::Move, Board::Undo> >& history,
+  PositionHistory& positions, ofstream* tracefile, Search& search, Ponder* ponder)
+{
+  SearchResult result;
+  bool pondered = ponder != nullptr && !history.empty() &&
+    ponder->finish(history.back().first, COMPUTER_MOVE_MS, result);
+  if (!pondered)
+    result = search.run(board, SearchLimits::forTime(COMPUTER_MOVE_MS), positions);
+  if (!result.hasMove)
+  {
+    cout << "*** Computer has no move" << endl;
+    return false;
+  }
+  cout << "Computer plays " << Board::moveName(result.bestMove)
+    << " (score " << result.score << ", depth " << result.depth
+    << (pondered ? ", pondered" : "") << ")" << endl;
+  playMove(board, history, positions, tracefile, result.bestMove);
+  if (ponder != nullptr && result.pv.size() > 1)
+    ponder->start(board, positions, result.pv[1]);
+  return true;
+}
+
 int main(int argc, char* argv[])
 {
   ofstream* tracefile = nullptr;
+  string archiveName;
 
   cout << "Welcome to CyclinderCheckers 0.1" << endl;
   help();
 
   if (argc > 1)
   {
-    tracefile = new ofstream(argv[1]);
+    string name = argv[1];
+    if (name.size() > 5 && name.substr(name.size() - 5) == ".ccgr")
+      archiveName = name;
+    else
+      tracefile = new ofstream(argv[1]);
   }
 
+  TranspositionTable tt(16);
+  Tablebase tablebase("tb");
+  Search search(tt);
+  search.setInfo(&cout);
+  search.setTablebase(&tablebase);
+  // Pondering searches on its own thread, sharing the table; it says
+  // nothing, so the prompt stays the player's
+  Search ponderSearch(tt);
+  ponderSearch.setTablebase(&tablebase);
+  Ponder ponder(ponderSearch);
+  bool pondering = true;
+  int computerPlayer = -1;
+
   Board board;
-  while ( (board.isStalemate() == false) &&
+  vector<pair<Board::Move, Board::Undo> > history;
+  PositionHistory positions;
+  while ( (positions.isDraw(board) == false) &&
           (board.isPlayerVictory() == -1) )
   {
-    ofstream* fileOut = nullptr;
+    if (board.sideToMove() == computerPlayer)
+    {
+      if (!computerMove(board, history, positions, tracefile, search, pondering ? &ponder : nullptr))
+        computerPlayer = -1;
+      continue;
+    }
 
     cout << board.dump() << endl;
 
@@ -74,6 +155,81 @@ int main(int argc, char* argv[])
     else if (input == "HELP" || input == "help" || input == "h")
     {
       help();
+      continue;
+    }
+    else if (input == "UNDO" || input == "undo" || input == "u")
+    {
+      if (history.empty())
+      {
+        cout << "*** ERROR: Nothing to undo" << endl;
+      }
+      else
+      {
+        // Against the computer, take back its reply as well
+        ponder.cancel();
+        do
+        {
+          board.unmakeMove(history.back().first, history.back().second);
+          history.pop_back();
+          positions.pop();
+          if (tracefile != nullptr)
+            (*tracefile) << "// undo" << endl;
+        } while (board.sideToMove() == computerPlayer && !history.empty());
+      }
+      continue;
+    }
+
+    else if (input == "GO" || input == "go" || input == "g")
+    {
+      ponder.cancel();
+      computerMove(board, history, positions, tracefile, search, nullptr);
+      continue;
+    }
+    else if (input == "COMPUTER" || input == "computer" || input == "c")
+    {
+      // The computer takes whichever side isn't about to move
+      computerPlayer = (computerPlayer == -1) ?
+        Board::opponent(board.sideToMove()) : -1;
+      cout << (computerPlayer == -1 ? "Computer stopped" :
+        "Computer plays " + to_string(computerPlayer)) << endl;
+      if (computerPlayer == -1)
+        ponder.cancel();
+      continue;
+    }
+    else if (input == "PONDER" || input == "ponder")
+    {
+      pondering = !pondering;
+      if (!pondering)
+        ponder.cancel();
+      cout << (pondering ? "Pondering on" : "Pondering off") << endl;
+      continue;
+    }
+
+    else if (input == "TB" || input == "tb")
+    {
+      Tablebase::Result r;
+      if (!tablebase.probe(board, r))
+        cout << "Not in the tablebase (" << tablebase.tables() << " tables, up to "
+          << tablebase.maxPieces() << " pieces; build them with tbgen)" << endl;
+      else if (r.outcome == Tablebase::DRAW)
+        cout << "Draw" << endl;
+      else
+        cout << "Player " << board.sideToMove() << (r.outcome == Tablebase::WIN ? " wins" : " loses")
+          << " in " << r.plies << " plies" << endl;
+      continue;
+    }
+
+    else if (input == "EVAL" || input == "eval")
+    {
+      Evaluation evaluation;
+      for (int p=1; p<=2; p++)
+        cout << "Player " << p << ": " << board.feature(p, Board::PAWNS) << " pawns, "
+          << board.feature(p, Board::KINGS) << " kings, advancement "
+          << board.feature(p, Board::ADVANCEMENT) << ", back row "
+          << board.feature(p, Board::BACK_ROW) << ", mobility " << board.mobility(p)
+          << " = " << evaluation.score(board, p) << endl;
+      cout << "Score for player " << board.sideToMove() << ": " << evaluation.score(board) << endl;
+      continue;
     }
 
     tuple<bool, Board::Coord, Board::Coord> move = parseCoords(input);
@@ -81,14 +237,14 @@ int main(int argc, char* argv[])
     {
       Board::Coord from = get<1>(move);
       Board::Coord to = get<2>(move);
-      if (!board.move(from, to))
+      Board::Move m;
+      if (!board.findMove(from, to, m))
       {
         cout << "*** ERROR: Illegal move" << endl;
       }
       else
       {
-        (*tracefile) << "board.move(Board::" << ((char)(from.row - 32)) << from.col
-          << ",Board::" << ((char)(to.row - 32)) << to.col << ");" << endl;
+        playMove(board, history, positions, tracefile, m);
       }
     }
     else
@@ -97,6 +253,34 @@ int main(int argc, char* argv[])
     }
   }
 
+  ponder.cancel();
+  int winner = board.isPlayerVictory();
+  if (winner != -1)
+    cout << board.dump() << endl << "Player " << winner << " wins" << endl;
+  else if (positions.isDraw(board))
+    cout << board.dump() << endl << "Draw" << endl;
+
   if (tracefile != nullptr)
     delete tracefile;
+
+  if (!archiveName.empty())
+  {
+    GameRecord game;
+    for (size_t i=0; i<history.size(); i++)
+      game.moves.push_back(history[i].first);
+    if (winner != -1)
+      game.result = winner;
+    else if (positions.isDraw(board))
+      game.result = GameRecord::DRAW;
+    try
+    {
+      GameWriter archive(archiveName);
+      archive.add(game);
+      archive.close();
+    }
+    catch (const char* message)
+    {
+      cout << "*** ERROR: " << message << endl;
+    }
+  }
 }
@@ -0,0 +1,69 @@
+/*
+ * Convert: imports console trace files into a binary game archive, one
+ * game per trace
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "GameRecord.h"
+
+void usage()
+{
+  cout << "convert [-o archive] trace ... : Import trace files as games" << endl;
+  cout << "                                 (default archive: games.ccgr)" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  string filename = "games.ccgr";
+  vector<string> traces;
+  for (int i=1; i<argc; i++)
+  {
+    string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      usage();
+      return 0;
+    }
+    else if (arg == "-o" && i + 1 < argc)
+      filename = argv[++i];
+    else
+      traces.push_back(arg);
+  }
+  if (traces.empty())
+  {
+    usage();
+    return 2;
+  }
+
+  try
+  {
+    GameWriter archive(filename);
+    GameRecord game;
+    uint64_t moves = 0;
+    for (size_t i=0; i<traces.size(); i++)
+    {
+      ifstream in(traces[i]);
+      if (!in)
+      {
+        cout << "*** ERROR: Unable to open " << traces[i] << endl;
+        return 1;
+      }
+      GameArchive::readTrace(in, game);
+      archive.add(game);
+      moves += game.moves.size();
+    }
+    archive.close();
+    cout << archive.games() << " games, " << moves << " moves written to " << filename << endl;
+  }
+  catch (const char* message)
+  {
+    cout << "*** ERROR: " << message << endl;
+    return 1;
+  }
+  return 0;
+}
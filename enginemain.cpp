@@ -0,0 +1,75 @@
+/*
+ * Engine: serves the text protocol (see Protocol.h) on stdin/stdout,
+ * for programs that play many games through one engine process
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "Evaluation.h"
+#include "Protocol.h"
+#include "ThreadPool.h"
+
+void usage()
+{
+  cout << "engine [options] : Serve the engine protocol on stdin/stdout" << endl;
+  cout << "  -t threads      : Searches run at once (default 0, one per hardware thread)" << endl;
+  cout << "  -hash megabytes : Transposition table size per search running (default 16)" << endl;
+  cout << "  -w file         : Load evaluation weights from file" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  int threads = 0;
+  int megabytes = 16;
+  Evaluation evaluation;
+  try
+  {
+    for (int i=1; i<argc; i++)
+    {
+      string arg = argv[i];
+      if (arg == "--help" || arg == "-h")
+      {
+        usage();
+        return 0;
+      }
+      else if (arg == "-t" && i + 1 < argc)
+        threads = atoi(argv[++i]);
+      else if (arg == "-hash" && i + 1 < argc)
+        megabytes = max(1, atoi(argv[++i]));
+      else if (arg == "-w" && i + 1 < argc)
+        evaluation.load(argv[++i]);
+      else
+      {
+        usage();
+        return 2;
+      }
+    }
+  }
+  catch (const char* message)
+  {
+    cout << "*** ERROR: " << message << endl;
+    return 2;
+  }
+
+  // Unsynced, so a batch of commands sits in cin's buffer and its
+  // replies go out together once the batch has been read
+  ios::sync_with_stdio(false);
+  ThreadPool pool(threads);
+  Protocol protocol(cout, pool, megabytes);
+  protocol.setEvaluation(evaluation);
+
+  string line;
+  while (getline(cin, line))
+  {
+    if (!protocol.handle(line))
+      break;
+    if (cin.rdbuf()->in_avail() <= 0)
+      protocol.flush();
+  }
+  protocol.waitAll();
+  protocol.flush();
+  return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * Loadgen: plays games against a running server from many connections
+ * at once, and reports moves/sec and move latency percentiles
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "Server.h"
+
+void usage()
+{
+  cout << "loadgen [options] : Play games against a server and time its moves" << endl;
+  cout << "  -u path     : Connect to a Unix-domain socket" << endl;
+  cout << "  -p port     : Connect to a TCP port on 127.0.0.1" << endl;
+  cout << "  -c clients  : Connections, each with its own thread (default 8)" << endl;
+  cout << "  -g games    : Games per connection (default 20)" << endl;
+  cout << "  -n nodes    : Node budget for the engine's moves (default 500; 0 plays both sides at random)" << endl;
+  cout << "  -max plies  : Plies before a game is abandoned (default 200)" << endl;
+  cout << "Each game has a random mover against the engine; the engine's" << endl;
+  cout << "moves are a go followed by the moves that play its answer." << endl;
+}
+
+struct Totals
+{
+public:
+  uint64_t games;
+  uint64_t errors;
+  vector<double> moveMs; // moves command to ok
+  vector<double> searchMs; // go to bestmove
+};
+
+double since(chrono::steady_clock::time_point start)
+{
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Everything after "kind id" in a reply, or throws if it's something else
+vector<string> expect(ServerClient& client, const string& kind, const string& id)
+{
+  string line = client.receive();
+  istringstream fields(line);
+  string word;
+  vector<string> words;
+  while (fields >> word)
+    words.push_back(word);
+  if (words.size() < 2 || words[0] != kind || words[1] != id)
+    throw "Unexpected reply";
+  return vector<string>(words.begin() + 2, words.end());
+}
+
+void playGames(ServerClient& client, int connection, int games, int nodes, int maxPlies, Totals& totals)
+{
+  mt19937 random(connection + 1);
+  for (int g=0; g<games; g++)
+  {
+    string id = "c" + to_string(connection) + "g" + to_string(g);
+    client.send("position " + id + " start");
+    expect(client, "ok", id);
+    for (int ply=0; ply<maxPlies; ply++)
+    {
+      string move;
+      if (nodes > 0 && ply % 2 == 1)
+      {
+        auto start = chrono::steady_clock::now();
+        client.send("go " + id + " nodes " + to_string(nodes));
+        vector<string> best = expect(client, "bestmove", id);
+        totals.searchMs.push_back(since(start));
+        move = best.empty() ? "none" : best[0];
+      }
+      else
+      {
+        client.send("legal " + id);
+        vector<string> legal = expect(client, "legal", id);
+        move = legal.empty() ? "none" : legal[random() % legal.size()];
+      }
+      if (move == "none")
+        break;
+
+      auto start = chrono::steady_clock::now();
+      client.send("moves " + id + " " + move);
+      string reply = client.receive();
+      totals.moveMs.push_back(since(start));
+      if (reply != "ok " + id)
+      {
+        totals.errors++;
+        break;
+      }
+    }
+    client.send("close " + id);
+    expect(client, "ok", id);
+    totals.games++;
+  }
+}
+
+double percentile(vector<double>& values, double p)
+{
+  if (values.empty())
+    return 0;
+  sort(values.begin(), values.end());
+  size_t i = (size_t)(p * (values.size() - 1) + 0.5);
+  return values[min(i, values.size() - 1)];
+}
+
+int main(int argc, char* argv[])
+{
+  string path;
+  int port = -1;
+  int clients = 8;
+  int games = 20;
+  int nodes = 500;
+  int maxPlies = 200;
+  for (int i=1; i<argc; i++)
+  {
+    string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      usage();
+      return 0;
+    }
+    else if (arg == "-u" && i + 1 < argc)
+      path = argv[++i];
+    else if (arg == "-p" && i + 1 < argc)
+      port = atoi(argv[++i]);
+    else if (arg == "-c" && i + 1 < argc)
+      clients = max(1, atoi(argv[++i]));
+    else if (arg == "-g" && i + 1 < argc)
+      games = max(1, atoi(argv[++i]));
+    else if (arg == "-n" && i + 1 < argc)
+      nodes = max(0, atoi(argv[++i]));
+    else if (arg == "-max" && i + 1 < argc)
+      maxPlies = max(1, atoi(argv[++i]));
+    else
+    {
+      usage();
+      return 2;
+    }
+  }
+  if (path.empty() == (port < 0))
+  {
+    usage();
+    return 2;
+  }
+
+  Totals all = Totals();
+  mutex totalsLock;
+  bool failed = false;
+  auto start = chrono::steady_clock::now();
+  vector<thread> threads;
+  for (int c=0; c<clients; c++)
+  {
+    threads.push_back(thread([&, c]() {
+      Totals mine = Totals();
+      try
+      {
+        unique_ptr<ServerClient> client(path.empty() ? new ServerClient(port) : new ServerClient(path));
+        playGames(*client, c, games, nodes, maxPlies, mine);
+      }
+      catch (const char* message)
+      {
+        lock_guard<mutex> hold(totalsLock);
+        cout << "*** ERROR: connection " << c << ": " << message << endl;
+        failed = true;
+      }
+      lock_guard<mutex> hold(totalsLock);
+      all.games += mine.games;
+      all.errors += mine.errors;
+      all.moveMs.insert(all.moveMs.end(), mine.moveMs.begin(), mine.moveMs.end());
+      all.searchMs.insert(all.searchMs.end(), mine.searchMs.begin(), mine.searchMs.end());
+    }));
+  }
+  for (size_t i=0; i<threads.size(); i++)
+    threads[i].join();
+  double seconds = since(start) / 1000;
+
+  cout << clients << " connections, " << all.games << " games, " << all.moveMs.size() << " moves in "
+    << seconds << "s (" << (uint64_t)(all.moveMs.size() / (seconds > 0 ? seconds : 1))
+    << " moves/sec), " << all.errors << " rejected" << endl;
+  cout << "move ms: p50 " << percentile(all.moveMs, 0.50) << " p90 " << percentile(all.moveMs, 0.90)
+    << " p99 " << percentile(all.moveMs, 0.99) << endl;
+  if (!all.searchMs.empty())
+    cout << "search ms: p50 " << percentile(all.searchMs, 0.50) << " p90 " << percentile(all.searchMs, 0.90)
+      << " p99 " << percentile(all.searchMs, 0.99) << endl;
+  return failed ? 1 : 0;
+}
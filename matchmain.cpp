@@ -0,0 +1,178 @@
+/*
+ * Match: plays the alpha-beta engine against the Monte Carlo one at the
+ * same time per move, to compare their strength per CPU-second
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+#include "MonteCarlo.h"
+#include "PositionHistory.h"
+#include "Search.h"
+#include "ThreadPool.h"
+#include "TranspositionTable.h"
+
+void usage()
+{
+  cout << "match [options] : Play alpha-beta against Monte Carlo tree search" << endl;
+  cout << "  -g games        : Games to play (default 20), colours alternating" << endl;
+  cout << "  -t threads      : Games played at once (default 0, one per hardware thread)" << endl;
+  cout << "  -ms milliseconds: Time per move for both engines (default 100)" << endl;
+  cout << "  -r plies        : Random opening plies (default 4)" << endl;
+  cout << "  -max plies      : Plies before a game is a draw (default 200)" << endl;
+  cout << "  -seed n         : Seed for the random openings (default 1)" << endl;
+  cout << "  -hash megabytes : Transposition table size per game (default 16)" << endl;
+  cout << "  -tree megabytes : Monte Carlo tree size per game (default 64)" << endl;
+  cout << "Each engine thinks on one thread; games run side by side." << endl;
+}
+
+struct Tally
+{
+public:
+  int games;
+  int wins[2]; // alpha-beta, Monte Carlo
+  int draws;
+  uint64_t nodes[2];
+  uint64_t ms[2];
+  uint64_t memory[2]; // the most one search used
+};
+
+// The winner, 1 or 2, or 0 for a draw; Monte Carlo plays player mcPlayer
+int playGame(Search& search, MonteCarlo& mc, int mcPlayer, int moveMs, int randomPlies,
+  int maxPlies, mt19937_64& random, Tally& tally)
+{
+  Board board;
+  PositionHistory history;
+  Board::MoveList list;
+  mc.clear();
+  for (int ply=0; ply<maxPlies; ply++)
+  {
+    board.generateMoves(board.sideToMove(), list);
+    if (list.empty())
+      return Board::opponent(board.sideToMove());
+    if (history.isDraw(board))
+      return 0;
+
+    Board::Move m;
+    if (ply < randomPlies)
+      m = list[(int)(random() % (uint64_t)list.size())];
+    else
+    {
+      int engine = board.sideToMove() == mcPlayer ? 1 : 0;
+      SearchResult r = engine == 1 ?
+        mc.run(board, SearchLimits::forTime(moveMs), history) :
+        search.run(board, SearchLimits::forTime(moveMs), history);
+      m = r.bestMove;
+      tally.nodes[engine] += r.nodes;
+      tally.ms[engine] += r.milliseconds;
+      tally.memory[engine] = max(tally.memory[engine], r.memory);
+    }
+    history.push(board);
+    board.makeMove(m);
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  int games = 20;
+  int threads = 0;
+  int moveMs = 100;
+  int randomPlies = 4;
+  int maxPlies = 200;
+  uint64_t seed = 1;
+  int hashMegabytes = 16;
+  int treeMegabytes = 64;
+  for (int i=1; i<argc; i++)
+  {
+    string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      usage();
+      return 0;
+    }
+    else if (arg == "-g" && i + 1 < argc)
+      games = max(1, atoi(argv[++i]));
+    else if (arg == "-t" && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if (arg == "-ms" && i + 1 < argc)
+      moveMs = max(1, atoi(argv[++i]));
+    else if (arg == "-r" && i + 1 < argc)
+      randomPlies = max(0, atoi(argv[++i]));
+    else if (arg == "-max" && i + 1 < argc)
+      maxPlies = max(1, atoi(argv[++i]));
+    else if (arg == "-seed" && i + 1 < argc)
+      seed = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "-hash" && i + 1 < argc)
+      hashMegabytes = max(1, atoi(argv[++i]));
+    else if (arg == "-tree" && i + 1 < argc)
+      treeMegabytes = max(1, atoi(argv[++i]));
+    else
+    {
+      usage();
+      return 2;
+    }
+  }
+  if (threads <= 0)
+    threads = ThreadPool::hardwareThreads();
+  threads = min(threads, games);
+
+  Tally all = Tally();
+  mutex tallyLock;
+  atomic<int> next(0);
+  auto start = chrono::steady_clock::now();
+  vector<thread> workers;
+  for (int t=0; t<threads; t++)
+  {
+    workers.push_back(thread([&]() {
+      TranspositionTable tt(hashMegabytes);
+      Search search(tt);
+      MonteCarlo mc(treeMegabytes);
+      for (int g=next++; g<games; g=next++)
+      {
+        // A game pair shares its opening, with the colours swapped
+        mt19937_64 random(seed * 0x9E3779B97F4A7C15ull + (uint64_t)(g / 2));
+        mc.setSeed(seed + (uint64_t)g);
+        int mcPlayer = g % 2 == 0 ? 2 : 1;
+        Tally mine = Tally();
+        int winner = playGame(search, mc, mcPlayer, moveMs, randomPlies, maxPlies, random, mine);
+
+        lock_guard<mutex> hold(tallyLock);
+        all.games++;
+        if (winner == 0)
+          all.draws++;
+        else
+          all.wins[winner == mcPlayer ? 1 : 0]++;
+        for (int e=0; e<2; e++)
+        {
+          all.nodes[e] += mine.nodes[e];
+          all.ms[e] += mine.ms[e];
+          all.memory[e] = max(all.memory[e], mine.memory[e]);
+        }
+        cout << "game " << g << ": " << (winner == 0 ? "draw" :
+          winner == mcPlayer ? "Monte Carlo wins" : "alpha-beta wins")
+          << " (Monte Carlo played " << mcPlayer << ")" << endl;
+      }
+    }));
+  }
+  for (size_t i=0; i<workers.size(); i++)
+    workers[i].join();
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  cout << all.games << " games in " << seconds << "s at " << moveMs << "ms a move: alpha-beta "
+    << all.wins[0] << ", Monte Carlo " << all.wins[1] << ", draws " << all.draws << endl;
+  cout << "alpha-beta " << all.nodes[0] * 1000 / max(all.ms[0], (uint64_t)1) << " nodes/sec, "
+    << "Monte Carlo " << all.nodes[1] * 1000 / max(all.ms[1], (uint64_t)1) << " playouts/sec" << endl;
+  cout << "memory per search at most: alpha-beta " << all.memory[0] / 1024 << "k, Monte Carlo "
+    << all.memory[1] / 1024 << "k" << endl;
+  return 0;
+}
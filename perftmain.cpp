@@ -0,0 +1,142 @@
+/*
+ * Perft: counts leaf nodes of the move tree, to check the move
+ * generator against known-good counts and to measure its speed
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Board.h"
+#include "Perft.h"
+#include "ThreadPool.h"
+
+void usage()
+{
+  cout << "perft [-t threads] [depth] [position] : Count leaves per root move" << endl;
+  cout << "                                        (default: 1 thread, depth 6, start position;" << endl;
+  cout << "                                        -t 0 uses every hardware thread)" << endl;
+  cout << "perft [-t threads] --verify file      : Check every stored count in file" << endl;
+  cout << "perft --scaling [depth] [position]    : Time 1/2/4/8/all threads" << endl;
+}
+
+double secondsSince(chrono::steady_clock::time_point start)
+{
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int verify(const string& filename, ThreadPool* pool)
+{
+  vector<Perft::Count> counts = Perft::load(filename);
+  int failures = 0;
+  uint64_t total = 0;
+  auto start = chrono::steady_clock::now();
+  for (size_t i=0; i<counts.size(); i++)
+  {
+    Board board;
+    board.setPosition(counts[i].position);
+    uint64_t nodes = (pool != nullptr) ?
+      Perft::count(board, counts[i].depth, *pool) :
+      Perft::count(board, counts[i].depth);
+    total += nodes;
+    if (nodes != counts[i].nodes)
+    {
+      cout << "*** FAIL " << counts[i].position << " depth " << counts[i].depth
+        << ": expected " << counts[i].nodes << ", got " << nodes << endl;
+      failures++;
+    }
+  }
+  double seconds = secondsSince(start);
+  cout << "perft: " << counts.size() - failures << "/" << counts.size()
+    << " counts match, " << total << " nodes in " << seconds << "s ("
+    << (uint64_t)(total / (seconds > 0 ? seconds : 1)) << " nodes/sec)" << endl;
+  return failures == 0 ? 0 : 1;
+}
+
+void scaling(const Board& board, int depth)
+{
+  vector<int> threadCounts = { 1, 2, 4, 8 };
+  int all = ThreadPool::hardwareThreads();
+  if (all != 1 && all != 2 && all != 4 && all != 8)
+    threadCounts.push_back(all);
+
+  double base = 0;
+  for (size_t i=0; i<threadCounts.size(); i++)
+  {
+    ThreadPool pool(threadCounts[i]);
+    auto start = chrono::steady_clock::now();
+    uint64_t nodes = Perft::count(board, depth, pool);
+    double seconds = secondsSince(start);
+    if (i == 0)
+      base = seconds;
+    cout << threadCounts[i] << " threads: " << nodes << " nodes in " << seconds << "s ("
+      << (uint64_t)(nodes / (seconds > 0 ? seconds : 1)) << " nodes/sec, speedup "
+      << base / (seconds > 0 ? seconds : 1) << "x)" << endl;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    int threads = 1;
+    bool scale = false;
+    string verifyFile;
+    vector<string> args;
+    for (int i=1; i<argc; i++)
+    {
+      string arg = argv[i];
+      if (arg == "--help" || arg == "-h")
+      {
+        usage();
+        return 0;
+      }
+      else if (arg == "-t" && i + 1 < argc)
+        threads = atoi(argv[++i]);
+      else if (arg == "--verify" && i + 1 < argc)
+        verifyFile = argv[++i];
+      else if (arg == "--scaling")
+        scale = true;
+      else
+        args.push_back(arg);
+    }
+
+    unique_ptr<ThreadPool> pool;
+    if (threads != 1)
+      pool.reset(new ThreadPool(threads));
+
+    if (!verifyFile.empty())
+      return verify(verifyFile, pool.get());
+
+    int depth = (args.size() > 0) ? atoi(args[0].c_str()) : 6;
+    Board board;
+    if (args.size() > 1)
+      board.setPosition(args[1]);
+
+    if (scale)
+    {
+      scaling(board, depth);
+      return 0;
+    }
+
+    cout << board.position() << " depth " << depth << endl;
+    auto start = chrono::steady_clock::now();
+    uint64_t nodes = pool ?
+      Perft::divide(board, depth, *pool, cout) :
+      Perft::divide(board, depth, cout);
+    double seconds = secondsSince(start);
+    cout << "Nodes: " << nodes << endl;
+    cout << "Time: " << seconds << "s (" << (uint64_t)(nodes / (seconds > 0 ? seconds : 1))
+      << " nodes/sec)" << endl;
+  }
+  catch (const char* message)
+  {
+    cout << "*** ERROR: " << message << endl;
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * Replay: checks every game in one or more archives against the rules
+ * engine, reporting illegal moves and results that don't match
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "GameRecord.h"
+#include "Replay.h"
+#include "ThreadPool.h"
+
+void usage()
+{
+  cout << "replay [-t threads] [-l limit] archive ... : Replay and check every game" << endl;
+  cout << "  -t threads : Threads (default 0, one per hardware thread)" << endl;
+  cout << "  -l limit   : Problems to list per archive (default 20)" << endl;
+}
+
+string resultName(int result)
+{
+  switch (result)
+  {
+    case GameRecord::DRAW: return "draw";
+    case GameRecord::PLAYER1: return "player 1 wins";
+    case GameRecord::PLAYER2: return "player 2 wins";
+    default: return "unfinished";
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int threads = 0;
+  size_t limit = 20;
+  vector<string> archives;
+  for (int i=1; i<argc; i++)
+  {
+    string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      usage();
+      return 0;
+    }
+    else if (arg == "-t" && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if (arg == "-l" && i + 1 < argc)
+      limit = (size_t)atoi(argv[++i]);
+    else
+      archives.push_back(arg);
+  }
+  if (archives.empty())
+  {
+    usage();
+    return 2;
+  }
+
+  int failures = 0;
+  try
+  {
+    ThreadPool pool(threads);
+    for (size_t a=0; a<archives.size(); a++)
+    {
+      GameArchive archive(archives[a]);
+      Replay::Report r = Replay::run(archive, pool);
+
+      cout << archives[a] << ": " << r.games << " games, " << r.moves << " moves in "
+        << r.seconds << "s (" << (uint64_t)(r.moves / (r.seconds > 0 ? r.seconds : 1))
+        << " moves/sec)" << endl;
+      cout << "  " << r.outcomes[GameRecord::PLAYER1] << " player 1 wins, "
+        << r.outcomes[GameRecord::PLAYER2] << " player 2 wins, "
+        << r.outcomes[GameRecord::DRAW] << " draws, "
+        << r.outcomes[GameRecord::UNKNOWN] << " unfinished, "
+        << r.illegal.size() << " with illegal moves, "
+        << r.mismatched.size() << " with mismatched results" << endl;
+
+      for (size_t i=0; i<r.illegal.size() && i<limit; i++)
+        cout << "  *** game " << r.illegal[i].game << " ply " << r.illegal[i].ply
+          << ": illegal move " << Board::squareName(r.illegal[i].from) << ","
+          << Board::squareName(r.illegal[i].to) << endl;
+      for (size_t i=0; i<r.mismatched.size() && i<limit; i++)
+        cout << "  *** game " << r.mismatched[i].game << ": recorded "
+          << resultName(r.mismatched[i].recorded) << ", replayed "
+          << resultName(r.mismatched[i].replayed) << endl;
+
+      if (!r.illegal.empty() || !r.mismatched.empty())
+        failures++;
+    }
+  }
+  catch (const char* message)
+  {
+    cout << "*** ERROR: " << message << endl;
+    return 2;
+  }
+  return failures == 0 ? 0 : 1;
+}
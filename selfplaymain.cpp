@@ -0,0 +1,116 @@
+/*
+ * Selfplay: plays the engine against itself on every core and streams
+ * the games to a file, for tuning and rule experiments
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "SelfPlay.h"
+#include "ThreadPool.h"
+
+void usage()
+{
+  cout << "selfplay [options] : Play the engine against itself" << endl;
+  cout << "  -g games        : Games to play (default 100)" << endl;
+  cout << "  -t threads      : Games played at once (default 0, one per hardware thread)" << endl;
+  cout << "  -n nodes        : Node budget per move (default 2000 if no other budget)" << endl;
+  cout << "  -ms milliseconds: Time budget per move" << endl;
+  cout << "  -d depth        : Depth limit per move" << endl;
+  cout << "  -r plies        : Random opening plies (default 4)" << endl;
+  cout << "  -max plies      : Plies before a game is a draw (default 200)" << endl;
+  cout << "  -seed n         : Seed for the random openings (default 1)" << endl;
+  cout << "  -hash megabytes : Transposition table size per thread (default 4)" << endl;
+  cout << "  -batch games    : Games per write to the output (default 16)" << endl;
+  cout << "  -w file         : Load evaluation weights from file" << endl;
+  cout << "  -o file         : Output file (default selfplay.txt; a .ccgr file is a game archive)" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  SelfPlay::Settings settings;
+  settings.threads = 0;
+  settings.limits = SearchLimits();
+  string filename = "selfplay.txt";
+  string weights;
+  for (int i=1; i<argc; i++)
+  {
+    string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      usage();
+      return 0;
+    }
+    else if (arg == "-g" && i + 1 < argc)
+      settings.games = atoi(argv[++i]);
+    else if (arg == "-t" && i + 1 < argc)
+      settings.threads = atoi(argv[++i]);
+    else if (arg == "-n" && i + 1 < argc)
+      settings.limits.nodes = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "-ms" && i + 1 < argc)
+      settings.limits.milliseconds = atoi(argv[++i]);
+    else if (arg == "-d" && i + 1 < argc)
+      settings.limits.depth = atoi(argv[++i]);
+    else if (arg == "-r" && i + 1 < argc)
+      settings.randomPlies = atoi(argv[++i]);
+    else if (arg == "-max" && i + 1 < argc)
+      settings.maxPlies = atoi(argv[++i]);
+    else if (arg == "-seed" && i + 1 < argc)
+      settings.seed = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "-hash" && i + 1 < argc)
+      settings.hashMegabytes = atoi(argv[++i]);
+    else if (arg == "-batch" && i + 1 < argc)
+      settings.batchGames = atoi(argv[++i]);
+    else if (arg == "-o" && i + 1 < argc)
+      filename = argv[++i];
+    else if (arg == "-w" && i + 1 < argc)
+      weights = argv[++i];
+    else
+    {
+      usage();
+      return 2;
+    }
+  }
+
+  if (settings.limits.depth == 0 && settings.limits.nodes == 0 && settings.limits.milliseconds == 0)
+    settings.limits.nodes = 2000;
+  if (settings.threads <= 0)
+    settings.threads = ThreadPool::hardwareThreads();
+
+  try
+  {
+    if (!weights.empty())
+      settings.evaluation.load(weights);
+    ThreadPool pool(settings.threads);
+    SelfPlay::Summary summary;
+    if (filename.size() > 5 && filename.substr(filename.size() - 5) == ".ccgr")
+    {
+      GameWriter archive(filename);
+      summary = SelfPlay::run(settings, pool, archive, &cout);
+      archive.close();
+    }
+    else
+    {
+      ofstream out(filename, ios::binary | ios::trunc);
+      if (!out)
+        throw "Unable to open output file";
+      summary = SelfPlay::run(settings, pool, out, &cout);
+    }
+    cout << summary.games << " games in " << summary.seconds << "s ("
+      << (uint64_t)summary.gamesPerHour() << " games/hour): "
+      << summary.results[1] << " player 1 wins, " << summary.results[2] << " player 2 wins, "
+      << summary.results[0] << " draws; "
+      << (summary.games > 0 ? summary.plies / summary.games : 0) << " plies and "
+      << (uint64_t)(summary.nodes / (summary.seconds > 0 ? summary.seconds : 1))
+      << " nodes/sec" << endl;
+  }
+  catch (const char* message)
+  {
+    cout << "*** ERROR: " << message << endl;
+    return 2;
+  }
+  return 0;
+}
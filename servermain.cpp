@@ -0,0 +1,100 @@
+/*
+ * Server: keeps many games in one process and serves the engine
+ * protocol over local sockets (see Server.h)
+ */
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "Evaluation.h"
+#include "Server.h"
+#include "ThreadPool.h"
+
+void usage()
+{
+  cout << "server [options] : Serve games over local sockets until interrupted" << endl;
+  cout << "  -u path         : Listen on a Unix-domain socket" << endl;
+  cout << "  -p port         : Listen on a TCP port on 127.0.0.1" << endl;
+  cout << "  -t threads      : Search threads (default 0, one per hardware thread)" << endl;
+  cout << "  -hash megabytes : Transposition table size per search running (default 16)" << endl;
+  cout << "  -w file         : Load evaluation weights from file" << endl;
+}
+
+Server* running = nullptr;
+
+void interrupted(int)
+{
+  if (running != nullptr)
+    running->stop();
+}
+
+int main(int argc, char* argv[])
+{
+  string path;
+  int port = -1;
+  int threads = 0;
+  int megabytes = 16;
+  Evaluation evaluation;
+  try
+  {
+    for (int i=1; i<argc; i++)
+    {
+      string arg = argv[i];
+      if (arg == "--help" || arg == "-h")
+      {
+        usage();
+        return 0;
+      }
+      else if (arg == "-u" && i + 1 < argc)
+        path = argv[++i];
+      else if (arg == "-p" && i + 1 < argc)
+        port = atoi(argv[++i]);
+      else if (arg == "-t" && i + 1 < argc)
+        threads = atoi(argv[++i]);
+      else if (arg == "-hash" && i + 1 < argc)
+        megabytes = max(1, atoi(argv[++i]));
+      else if (arg == "-w" && i + 1 < argc)
+        evaluation.load(argv[++i]);
+      else
+      {
+        usage();
+        return 2;
+      }
+    }
+    if (path.empty() && port < 0)
+    {
+      usage();
+      return 2;
+    }
+
+    ThreadPool pool(threads);
+    Server server(pool, megabytes);
+    server.setEvaluation(evaluation);
+    if (!path.empty())
+    {
+      server.listenUnix(path);
+      cout << "Listening on " << path << endl;
+    }
+    if (port >= 0)
+    {
+      server.listenTcp(port);
+      cout << "Listening on 127.0.0.1:" << server.tcpPort() << endl;
+    }
+
+    running = &server;
+    signal(SIGINT, interrupted);
+    signal(SIGTERM, interrupted);
+    signal(SIGPIPE, SIG_IGN);
+    server.run();
+    running = nullptr;
+  }
+  catch (const char* message)
+  {
+    cout << "*** ERROR: " << message << endl;
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Tbgen: solves every endgame up to a number of pieces by retrograde
+ * analysis and writes the tablebase files the engine probes
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "Tablebase.h"
+
+void usage()
+{
+  cout << "tbgen [-p pieces] [-d directory] : Solve all endgames with up to pieces pieces" << endl;
+  cout << "                                   (default: 4 pieces, into tb)" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  int pieces = 4;
+  string directory = "tb";
+  for (int i=1; i<argc; i++)
+  {
+    string arg = argv[i];
+    if (arg == "-p" && i + 1 < argc)
+      pieces = atoi(argv[++i]);
+    else if (arg == "-d" && i + 1 < argc)
+      directory = argv[++i];
+    else
+    {
+      usage();
+      return (arg == "--help" || arg == "-h") ? 0 : 2;
+    }
+  }
+  if (pieces < 1 || pieces > 15)
+  {
+    cout << "*** ERROR: pieces must be between 1 and 15" << endl;
+    return 2;
+  }
+
+  try
+  {
+    auto start = chrono::steady_clock::now();
+    Tablebase::generate(directory, pieces, &cout);
+    cout << "Done in " << chrono::duration<double>(chrono::steady_clock::now() - start).count()
+      << "s" << endl;
+  }
+  catch (const char* message)
+  {
+    cout << "*** ERROR: " << message << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -1,9 +1,33 @@
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
 #include <iostream>
+#include <sstream>
+#include <thread>
 #include <tuple>
+#include <vector>
 using namespace std;
 
+#include "Arena.h"
 #include "Board.h"
+#include "Evaluation.h"
+#include "GameRecord.h"
+#include "MonteCarlo.h"
+#include "Perft.h"
+#include "Ponder.h"
+#include "PositionBatch.h"
+#include "PositionHistory.h"
+#include "Protocol.h"
+#include "Server.h"
+#include "Replay.h"
+#include "Search.h"
+#include "SelfPlay.h"
+#include "Tablebase.h"
+#include "ThreadPool.h"
+#include "TranspositionTable.h"
 
 void pieceCanBeDumped()
 {
@@ -32,6 +56,26 @@ void coordDiagonalsAreCorrect()
   assert(F8.lowerRight() == Board::Coord('g',1));
 }
 
+void neighbourTablesMatchCoordDiagonals()
+{
+  for (int sq=0; sq<Board::SQUARES; sq++)
+  {
+    Board::Coord c = Board::coordOf(sq);
+    Board::Coord steps[4] = { c.upperRight(), c.upperLeft(), c.lowerRight(), c.lowerLeft() };
+    Board::Coord jumps[4] = {
+      c.upperRight().upperRight(), c.upperLeft().upperLeft(),
+      c.lowerRight().lowerRight(), c.lowerLeft().lowerLeft()
+    };
+    for (int d=0; d<4; d++)
+    {
+      assert(Board::STEP[sq][d] == Board::squareOf(steps[d]));
+      assert(Board::JUMP[sq][d] == Board::squareOf(jumps[d]));
+      assert(Board::JUMPED[sq][d] ==
+        (Board::JUMP[sq][d] == Board::NO_SQUARE ? Board::NO_SQUARE : Board::STEP[sq][d]));
+    }
+  }
+}
+
 void boardCanBeCleared()
 {
   Board board;
@@ -54,7 +98,7 @@ void boardHoldsEmptyPieces()
 void boardCanNormalizeColumns()
 {
   Board board;
-  Piece unique(3, 3); // nonsensical Piece for easy testing
+  Piece unique(0, 1); // nonsensical Piece (no player 0 in a normal game) for easy testing
   board.set(unique, Board::Coord('a', 1));
 
   Piece a1 = board.get(Board::Coord('a', 1));
@@ -78,6 +122,29 @@ void boardIsSetUpForTwoPlayers()
   assert(board.get(Board::Coord('g', 1)) == Piece(2));
 }
 
+void boardIsPackedIntoDarkSquares()
+{
+  assert(Board::squareOf(Board::A1) == 0);
+  assert(Board::squareOf(Board::B2) == 4);
+  assert(Board::squareOf(Board::B8) == 7);
+  assert(Board::squareOf(Board::H8) == 31);
+  assert(Board::squareOf(Board::A2) == Board::NO_SQUARE);
+  assert(Board::squareOf(Board::Coord('d', 12)) == Board::squareOf(Board::D4));
+  for (int sq=0; sq<Board::SQUARES; sq++)
+    assert(Board::squareOf(Board::coordOf(sq)) == sq);
+
+  Board board;
+  assert(board.playerMask(1) == 0x00000FFFu);
+  assert(board.playerMask(2) == 0xFFF00000u);
+  assert(board.kingMask() == 0);
+
+  // A board is a plain value; copies are independent
+  Board copy = board;
+  copy.set(Piece::NONE, Board::A1);
+  assert(board.get(Board::A1) == Piece(1));
+  assert(copy.get(Board::A1) == Piece::NONE);
+}
+
 void doNotAllowMovingNonpieces()
 {
   Board board;
@@ -182,12 +249,12 @@ void edgesKingMovement()
 {
   Board board;
   board.clear();
-  board.set(Piece(1, 1), Board::Coord('c',8));
+  board.set(Piece(1, 1), Board::Coord('d',8));
 
-  assert(board.legalMove(Board::Coord('c',8), Board::Coord('d',1)) == true);
-  assert(board.legalMove(Board::Coord('c',8), Board::Coord('d',7)) == true);
-  assert(board.legalMove(Board::Coord('c',8), Board::Coord('b',1)) == true);
-  assert(board.legalMove(Board::Coord('c',8), Board::Coord('b',7)) == true);
+  assert(board.legalMove(Board::Coord('d',8), Board::Coord('e',1)) == true);
+  assert(board.legalMove(Board::Coord('d',8), Board::Coord('e',7)) == true);
+  assert(board.legalMove(Board::Coord('d',8), Board::Coord('c',1)) == true);
+  assert(board.legalMove(Board::Coord('d',8), Board::Coord('c',7)) == true);
 }
 
 void pawnsCanJump()
@@ -218,7 +285,1508 @@ void pawnsCanJump()
 
 void kingsCanJump()
 {
+  // A king goes round four pieces and lands where it started; both ways
+  // round capture the same pieces, so they are one move
+  Board board;
+  board.clear();
+  board.set(Piece(1, 1), Board::D4);
+  board.set(Piece(2, 0), Board::C5);
+  board.set(Piece(2, 0), Board::C7);
+  board.set(Piece(2, 0), Board::E7);
+  board.set(Piece(2, 0), Board::E5);
+  Board::MoveList list;
+  board.generateMoves(1, list);
+  assert(list.size() == 1);
+  assert(list[0].from() == Board::squareOf(Board::D4) && list[0].to() == list[0].from());
+  assert(list[0].jumps() == 4);
+  assert(board.legalMove(Board::D4, Board::D4));
+  assert(!board.legalMove(Board::D4, Board::B6));
+
+  string before = board.dump();
+  Board::Undo undo = board.makeMove(list[0]);
+  assert(board.get(Board::D4).player == 1 && board.get(Board::D4).isKing());
+  assert(board.playerPiecesRemaining(2) == 0);
+  board.unmakeMove(list[0], undo);
+  assert(board.dump() == before);
+
+  // A pawn's chain crosses the column seam, and capturing is compulsory:
+  // the other pawn may not step, and the chain may not stop half way
+  board.clear();
+  board.setPlayerDirection(1, Board::Direction::A_TO_H);
+  board.setPlayerDirection(2, Board::Direction::H_TO_A);
+  board.set(Piece(1, 0), Board::B2);
+  board.set(Piece(1, 0), Board::A5);
+  board.set(Piece(2, 0), Board::C1);
+  board.set(Piece(2, 0), Board::E7);
+  assert(!board.legalMove(Board::A5, Board::B4));
+  assert(!board.legalMove(Board::B2, Board::D8));
+  assert(board.legalMove(Board::B2, Board::F6));
+  assert(board.move(Board::B2, Board::F6));
+  assert(board.get(Board::C1) == Piece::NONE && board.get(Board::E7) == Piece::NONE);
+  assert(board.get(Board::F6).player == 1);
+}
+
+// The rules the slow way, square by square through Coords and get(),
+// to check the generator's mask work against
+bool referenceMayMove(Board& board, int player, bool king, int d)
+{
+  if (king)
+    return true;
+  bool down = board.getPlayerDirection(player) == Board::Direction::A_TO_H;
+  return down ? d >= 2 : d < 2;
+}
+Board::Coord referenceStep(Board::Coord c, int d)
+{
+  switch (d)
+  {
+    case 0: return c.upperRight();
+    case 1: return c.upperLeft();
+    case 2: return c.lowerRight();
+    default: return c.lowerLeft();
+  }
+}
+void referenceChains(Board& board, int player, bool king, const Board::Coord& from,
+  const Board::Coord& at, int first, uint32_t captured, vector<Board::Move>& out)
+{
+  bool extended = false;
+  for (int d=0; d<4; d++)
+  {
+    Board::Coord over = referenceStep(at, d);
+    if (!referenceMayMove(board, player, king, d) || over.row == -1)
+      continue;
+    Board::Coord landing = referenceStep(over, d);
+    if (landing.row == -1)
+      continue;
+    Piece jumped = board.get(over);
+    uint32_t overBit = 1u << Board::squareOf(over);
+    if (jumped == Piece::NONE || jumped.player == player || (captured & overBit) != 0)
+      continue;
+    if (board.get(landing) != Piece::NONE && landing != from)
+      continue;
+    extended = true;
+    referenceChains(board, player, king, from, landing,
+      first == Board::NO_SQUARE ? Board::squareOf(over) : first, captured | overBit, out);
+  }
+  if (extended || captured == 0)
+    return;
+  Board::Move m = Board::Move::chain(Board::squareOf(from), Board::squareOf(at), first, captured);
+  if (find(out.begin(), out.end(), m) == out.end())
+    out.push_back(m);
+}
+vector<Board::Move> referenceMoves(Board& board, int player)
+{
+  vector<Board::Move> moves;
+  for (int sq=0; sq<Board::SQUARES; sq++)
+  {
+    Board::Coord from = Board::coordOf(sq);
+    Piece piece = board.get(from);
+    if (piece.player == player)
+      referenceChains(board, player, piece.isKing(), from, from, Board::NO_SQUARE, 0, moves);
+  }
+  if (!moves.empty())
+    return moves;
+
+  for (int sq=0; sq<Board::SQUARES; sq++)
+  {
+    Board::Coord from = Board::coordOf(sq);
+    Piece piece = board.get(from);
+    if (piece.player != player)
+      continue;
+    for (int d=0; d<4; d++)
+    {
+      Board::Coord to = referenceStep(from, d);
+      if (referenceMayMove(board, player, piece.isKing(), d) && to.row != -1 &&
+          board.get(to) == Piece::NONE)
+        moves.push_back(Board::Move(sq, Board::squareOf(to)));
+    }
+  }
+  return moves;
+}
+
+// What the generator reports must be the reference's moves, and its
+// (from, to) pairs exactly the set legalMove() accepts for that
+// player's pieces
+void checkGeneratorAgainstLegalMove(Board& board, int player)
+{
+  Board::MoveList list;
+  board.generateMoves(player, list);
+
+  // The same moves as the reference, each once
+  vector<Board::Move> reference = referenceMoves(board, player);
+  assert((int)reference.size() == list.size());
+  for (int i=0; i<list.size(); i++)
+    assert(find(reference.begin(), reference.end(), list[i]) != reference.end());
+
+  // Only chains can share their squares, and capturing is compulsory
+  bool generated[Board::SQUARES][Board::SQUARES] = { };
+  for (int i=0; i<list.size(); i++)
+  {
+    const Board::Move& m = list[i];
+    assert(!generated[m.from()][m.to()] || m.isJump());
+    generated[m.from()][m.to()] = true;
+    assert(board.get(Board::coordOf(m.from())).player == player);
+    assert(m.isJump() == list[0].isJump());
+    assert(board.isLegal(m));
+  }
+
+  for (int from=0; from<Board::SQUARES; from++)
+  {
+    if (board.get(Board::coordOf(from)).player != player)
+      continue;
+    for (int to=0; to<Board::SQUARES; to++)
+    {
+      bool legal = board.legalMove(Board::coordOf(from), Board::coordOf(to));
+      assert(legal == generated[from][to]);
+      Board::Move m;
+      assert(board.legalMove(from, to, m) == legal);
+      Board::Move generatedMove;
+      if (legal)
+        assert(board.findMove(Board::coordOf(from), Board::coordOf(to), generatedMove) &&
+          generatedMove == m);
+    }
+  }
+}
+
+void generatorMatchesLegalMove()
+{
+  Board board;
+  checkGeneratorAgainstLegalMove(board, 1);
+  checkGeneratorAgainstLegalMove(board, 2);
+
+  // Random mixes of pawns and kings, including across the column seam
+  srand(42);
+  for (int n=0; n<500; n++)
+  {
+    board.clear();
+    board.setPlayerDirection(1, Board::Direction::A_TO_H);
+    board.setPlayerDirection(2, Board::Direction::H_TO_A);
+    for (int sq=0; sq<Board::SQUARES; sq++)
+    {
+      int r = rand() % 8;
+      if (r < 3)
+        board.set(Piece(1 + (r % 2), r / 2), Board::coordOf(sq));
+    }
+    checkGeneratorAgainstLegalMove(board, 1);
+    checkGeneratorAgainstLegalMove(board, 2);
+  }
+}
+
+void customDirectionsAreHonoured()
+{
+  // Reversed and shared directions, and a third player, as a custom
+  // setup might have them
+  srand(7);
+  for (int n=0; n<200; n++)
+  {
+    Board board;
+    board.clear();
+    board.setPlayerDirection(1, (n % 2) ? Board::Direction::H_TO_A : Board::Direction::A_TO_H);
+    board.setPlayerDirection(2, (n % 3) ? Board::Direction::A_TO_H : Board::Direction::H_TO_A);
+    board.setPlayerDirection(0, Board::Direction::H_TO_A);
+    for (int sq=0; sq<Board::SQUARES; sq++)
+    {
+      int r = rand() % 12;
+      if (r < 6)
+        board.set(Piece(r % 3, r / 3), Board::coordOf(sq));
+    }
+    for (int p=0; p<=2; p++)
+      checkGeneratorAgainstLegalMove(board, p);
+  }
+
+  // A pawn promotes on the far row of whichever direction it was given
+  Board board;
+  board.clear();
+  board.set(Piece(1), Board::B2);
+  board.setPlayerDirection(1, Board::Direction::H_TO_A);
+  assert(!board.legalMove(Board::B2, Board::C1));
+  Board::Move m;
+  assert(board.legalMove(Board::squareOf(Board::B2), Board::squareOf(Board::A1), m));
+  board.makeMove(m);
+  assert(board.get(Board::A1) == Piece(1, 1));
+}
+
+bool sameBoard(const Board& lhs, const Board& rhs)
+{
+  for (int p=0; p<Board::MAX_PLAYERS; p++)
+  {
+    if (lhs.playerMask(p) != rhs.playerMask(p))
+      return false;
+  }
+  return lhs.kingMask() == rhs.kingMask();
+}
+
+void movesAreEncodedCompactly()
+{
+  Board::Move step(3, 7);
+  assert(step.from() == 3 && step.to() == 7);
+  assert(!step.isJump() && step.jumped() == Board::NO_SQUARE);
+
+  Board::Move jump(31, 0, 28);
+  assert(jump.from() == 31 && jump.to() == 0 && jump.jumped() == 28);
+  assert(jump.isJump());
+  assert(jump.captures == (1u << 28) && jump.jumps() == 1);
+
+  // A chain keeps every square it took; the path between doesn't matter
+  Board::Move chain = Board::Move::chain(0, 0, 4, 0x1230);
+  assert(chain.isJump() && chain.jumped() == 4 && chain.jumps() == 4);
+  assert(chain == Board::Move::chain(0, 0, 5, 0x1230));
+  assert(chain != Board::Move::chain(0, 0, 4, 0x1231));
+  assert(sizeof(jump.bits) == 2 && sizeof(Board::Move) == 8);
+}
+
+void unmakeMoveRestoresBoard()
+{
+  srand(7);
+  for (int n=0; n<200; n++)
+  {
+    Board board;
+    board.clear();
+    board.setPlayerDirection(1, Board::Direction::A_TO_H);
+    board.setPlayerDirection(2, Board::Direction::H_TO_A);
+    for (int sq=0; sq<Board::SQUARES; sq++)
+    {
+      int r = rand() % 8;
+      if (r < 3)
+        board.set(Piece(1 + (r % 2), r / 2), Board::coordOf(sq));
+    }
+
+    for (int player=1; player<=2; player++)
+    {
+      Board::MoveList list;
+      board.generateMoves(player, list);
+      for (int i=0; i<list.size(); i++)
+      {
+        Board before = board;
+        Board::Undo undo = board.makeMove(list[i]);
+        assert(!sameBoard(before, board));
+        board.unmakeMove(list[i], undo);
+        assert(sameBoard(before, board));
+      }
+    }
+  }
+}
+
+void makeMoveCapturesAndPromotes()
+{
+  Board board;
+  board.clear();
+  board.setPlayerDirection(1, Board::Direction::A_TO_H);
+  board.set(Piece(1), Board::F2);
+  board.set(Piece(2, 1), Board::G1);
+  Board before = board;
+
+  Board::Move m;
+  assert(board.findMove(Board::F2, Board::H8, m));
+  assert(m.isJump() && m.jumped() == Board::squareOf(Board::G1));
+  Board::Undo undo = board.makeMove(m);
+  uint32_t g1 = 1u << Board::squareOf(Board::G1);
+  assert(undo.captured[2] == g1 && undo.capturedKings == g1 && undo.promoted);
+  assert(board.get(Board::G1) == Piece::NONE);
+  assert(board.get(Board::H8) == Piece(1, 1));
+
+  board.unmakeMove(m, undo);
+  assert(sameBoard(before, board));
+  assert(board.get(Board::G1) == Piece(2, 1));
+  assert(board.get(Board::F2) == Piece(1));
+}
+
+void hashIsMaintainedIncrementally()
+{
+  Board board;
+  assert(board.hash() == board.computeHash());
+  assert(board.sideToMove() == 1);
+
+  // Play a long random game, checking the key after every make/unmake
+  srand(11);
+  Board::Move moves[200];
+  Board::Undo undos[200];
+  int played = 0;
+  for (; played<200; played++)
+  {
+    Board::MoveList list;
+    board.generateMoves(board.sideToMove(), list);
+    if (list.empty())
+      break;
+    moves[played] = list[rand() % list.size()];
+    undos[played] = board.makeMove(moves[played]);
+    assert(board.hash() == board.computeHash());
+
+    // The board's own key, which the hash is made of when the board is
+    // its own representative, matches one built from the masks
+    Board rebuilt;
+    rebuilt.setMasks(board.playerMask(1), board.playerMask(2), board.kingMask(), board.sideToMove());
+    assert(board.exactKey() == rebuilt.exactKey());
+  }
+  while (played > 0)
+  {
+    played--;
+    board.unmakeMove(moves[played], undos[played]);
+    assert(board.hash() == board.computeHash());
+  }
+  assert(board.hash() == Board().hash());
+
+  // set() and the side to move feed the key too
+  uint64_t start = board.hash();
+  board.set(Piece(2, 1), Board::D4);
+  assert(board.hash() != start && board.hash() == board.computeHash());
+  board.set(Piece::NONE, Board::D4);
+  assert(board.hash() == start);
+  board.setSideToMove(2);
+  assert(board.hash() != start && board.hash() == board.computeHash());
+}
+
+// The features counted square by square, to check the Board's popcounts against
+void checkFeatures(const Board& board)
+{
+  for (int p=1; p<=2; p++)
+  {
+    bool down = board.getPlayerDirection(p) == Board::Direction::A_TO_H;
+    uint32_t pawns = board.playerMask(p) & ~board.kingMask();
+    int advancement = 0;
+    for (int row=0; row<8; row++)
+      advancement += (down ? row : 7 - row) * __builtin_popcount(pawns & (0xFu << (row * 4)));
+    assert(board.feature(p, Board::PAWNS) == __builtin_popcount(pawns));
+    assert(board.feature(p, Board::KINGS) == __builtin_popcount(board.playerMask(p) & board.kingMask()));
+    assert(board.feature(p, Board::ADVANCEMENT) == advancement);
+    assert(board.feature(p, Board::BACK_ROW) ==
+      __builtin_popcount(pawns & (down ? 0x0000000Fu : 0xF0000000u)));
+    assert(board.playerPiecesRemaining(p) == __builtin_popcount(board.playerMask(p)));
+
+    Board::MoveList list;
+    board.generateMoves(p, list);
+    bool firstJumps[Board::SQUARES][Board::SQUARES] = { };
+    int mobility = 0;
+    for (int i=0; i<list.size(); i++)
+    {
+      if (!list[i].isJump() || !firstJumps[list[i].from()][list[i].jumped()])
+        mobility++;
+      if (list[i].isJump())
+        firstJumps[list[i].from()][list[i].jumped()] = true;
+    }
+    assert(board.mobility(p) == mobility);
+  }
+}
+
+void evaluationFeaturesAreCounted()
+{
+  Board board;
+  checkFeatures(board);
+  assert(board.playerPiecesRemaining(1) == 12 && board.feature(2, Board::BACK_ROW) == 4);
+
+  // Captures and promotions along random games, and back again
+  srand(17);
+  for (int game=0; game<20; game++)
+  {
+    Board::Move moves[300];
+    Board::Undo undos[300];
+    int played = 0;
+    for (; played<300; played++)
+    {
+      Board::MoveList list;
+      board.generateMoves(board.sideToMove(), list);
+      if (list.empty())
+        break;
+      moves[played] = list[rand() % list.size()];
+      undos[played] = board.makeMove(moves[played]);
+      checkFeatures(board);
+    }
+    while (played > 0)
+    {
+      played--;
+      board.unmakeMove(moves[played], undos[played]);
+      checkFeatures(board);
+    }
+  }
+
+  // set() and a change of direction are counted too
+  board.set(Piece(1, 1), Board::D4);
+  board.set(Piece::NONE, Board::C1);
+  checkFeatures(board);
+  board.setPlayerDirection(1, Board::Direction::H_TO_A);
+  checkFeatures(board);
+
+  // Weights come from text; names left out keep their defaults
+  Evaluation defaults, tuned;
+  istringstream weights("# tuned\npawn 90\nmobility 0\n");
+  tuned.read(weights);
+  assert(tuned.pawn == 90 && tuned.mobility == 0 && tuned.king == defaults.king);
+  Board start;
+  assert(tuned.score(start) == 0 && defaults.score(start) == 0);
+  assert(tuned.score(start, 1) == 90 * 12 + tuned.advancement * 12 + tuned.backRow * 4);
+  istringstream bad("queen 900\n");
+  bool threw = false;
+  try { tuned.read(bad); } catch (const char*) { threw = true; }
+  assert(threw);
+}
+
+void checkBatchFeatures(const PositionBatch& batch)
+{
+  for (size_t i=0; i<batch.size(); i++)
+  {
+    Board board = batch.board(i);
+    for (int p=1; p<=2; p++)
+    {
+      for (int f=0; f<Board::FEATURES; f++)
+        assert(batch.features[p - 1][f][i] == board.feature(p, (Board::Feature)f));
+      assert(batch.features[p - 1][PositionBatch::MOBILITY][i] == board.mobility(p));
+    }
+  }
+}
+
+void batchEvaluationMatchesBoards()
+{
+  // Positions from random games, an odd number so the vector kernel
+  // leaves some to the scalar one
+  PositionBatch batch;
+  srand(23);
+  for (int game=0; game<30; game++)
+  {
+    Board board;
+    for (int ply=0; ply<200; ply++)
+    {
+      batch.add(board);
+      Board::MoveList list;
+      board.generateMoves(board.sideToMove(), list);
+      if (list.empty())
+        break;
+      board.makeMove(list[rand() % list.size()]);
+    }
+  }
+  batch.add(Board());
+  assert(batch.size() % 8 != 0);
+
+  batch.computeFeaturesScalar();
+  checkBatchFeatures(batch);
+  if (PositionBatch::hasAvx2())
+  {
+    batch.computeFeaturesAvx2();
+    checkBatchFeatures(batch);
+  }
+
+  Evaluation tuned;
+  tuned.mobility = 4;
+  vector<int> scores;
+  tuned.score(batch, scores);
+  assert(scores.size() == batch.size());
+  for (size_t i=0; i<batch.size(); i++)
+    assert(scores[i] == tuned.score(batch.board(i)));
+
+  // Only the normal game fits a batch
+  Board custom;
+  custom.setPlayerDirection(2, Board::Direction::A_TO_H);
+  bool threw = false;
+  try { batch.add(custom); } catch (const char*) { threw = true; }
+  assert(threw);
+}
+
+void terminalStatesAreDetected()
+{
+  Board board;
+  assert(board.isPlayerVictory() == -1 && !board.isStalemate());
+
+  // No pieces, or no move, loses
+  board.setPosition("2:x.../..../..../..../..../..../..../....");
+  assert(board.isPlayerVictory() == 1);
+  board.setPosition("1:..../..../..../..../..../..../oooo/xxxx");
+  assert(board.isPlayerVictory() == 2);
+
+  // Two kings walking back and forth repeat the position every four plies
+  board.setPosition("1:X.../..../..../..../..../..../..../...O");
+  board.setDrawPlies(0);
+  PositionHistory history;
+  int a = 0, b = Board::STEP[0][Board::LOWER_RIGHT];
+  int c = 31, d = Board::STEP[31][Board::UPPER_LEFT];
+  Board::Move shuffle[4] = { Board::Move(a, b), Board::Move(c, d), Board::Move(b, a), Board::Move(d, c) };
+  Board::Undo undos[8];
+  for (int i=0; i<8; i++)
+  {
+    assert(!history.isDraw(board));
+    history.push(board);
+    undos[i] = board.makeMove(shuffle[i % 4]);
+    assert(board.getQuietPlies() == i + 1);
+  }
+  assert(history.repetitions(board) == 2 && history.isDraw(board) && !board.isStalemate());
+  assert(board.isPlayerVictory() == -1);
+  board.unmakeMove(shuffle[3], undos[7]);
+  history.pop();
+  assert(history.repetitions(board) == 1 && !history.isDraw(board) && board.getQuietPlies() == 7);
+  history.push(board);
+  board.makeMove(shuffle[3]);
+  assert(history.isDraw(board));
+
+  // The quiet-ply limit, and a pawn move starting the count again
+  board.setPosition("1:X.x./..../..../..../..../..../..../...O");
+  board.setDrawPlies(4);
+  history.clear();
+  for (int i=0; i<4; i++)
+  {
+    assert(!board.isStalemate());
+    history.push(board);
+    board.makeMove(shuffle[i]);
+  }
+  assert(history.repetitions(board) == 1 && board.isStalemate());
+  Board::Move pawn;
+  assert(board.legalMove(2, Board::STEP[2][Board::LOWER_RIGHT], pawn));
+  board.makeMove(pawn);
+  assert(board.getQuietPlies() == 0 && !board.isStalemate());
+}
+
+void transposedPositionsHashEqually()
+{
+  Board one;
+  assert(one.move(Board::C1, Board::D2));
+  assert(one.move(Board::F2, Board::E1));
+  assert(one.move(Board::C5, Board::D4));
+  assert(one.move(Board::F4, Board::E5));
+
+  Board two;
+  assert(two.move(Board::C5, Board::D4));
+  assert(two.move(Board::F4, Board::E5));
+  assert(two.move(Board::C1, Board::D2));
+  assert(two.move(Board::F2, Board::E1));
+
+  assert(one.hash() == two.hash());
+  assert(one.hash() != Board().hash());
+}
+
+void transpositionTableStoresAndProbes()
+{
+  TranspositionTable tt(1);
+  TranspositionTable::Entry e;
+  Board board;
+
+  assert(!tt.probe(board.hash(), e));
+  assert(tt.bytesUsed() == 0);
+  tt.store(board.hash(), 5, TranspositionTable::EXACT, -123, Board::Move(9, 13));
+  assert(tt.probe(board.hash(), e));
+  assert(e.depth == 5 && e.score == -123);
+  assert(e.bound == TranspositionTable::EXACT);
+  assert(e.move == Board::Move(9, 13));
+  assert(!tt.probe(board.hash() ^ 1, e));
+
+  // A shallower bound doesn't replace a deeper result for the same key
+  tt.store(board.hash(), 2, TranspositionTable::LOWER, 50, Board::Move(8, 12));
+  assert(tt.probe(board.hash(), e));
+  assert(e.depth == 5 && e.score == -123);
+
+  // Fill a bucket with deep entries; a shallow newcomer evicts only
+  // the shallowest one
+  tt.clear();
+  uint64_t stride = tt.entries() / 4;
+  for (uint64_t i=1; i<=4; i++)
+    tt.store(7 + i * stride, (int)(10 * i), TranspositionTable::EXACT, 0, Board::Move());
+  tt.store(7 + 5 * stride, 1, TranspositionTable::EXACT, 0, Board::Move());
+  assert(!tt.probe(7 + stride, e));
+  for (uint64_t i=2; i<=5; i++)
+    assert(tt.probe(7 + i * stride, e));
+
+  // One full bucket in the sampled 1024 reads as that share of the table
+  assert(tt.bytesUsed() == tt.bytes() / 1024);
+}
+
+void transpositionTableIsSafeAcrossThreads()
+{
+  // Every writer stores a score derived from its key; any entry a
+  // reader accepts must be one that some writer stored whole
+  TranspositionTable tt(1);
+  vector<thread> threads;
+  for (int t=0; t<4; t++)
+  {
+    threads.push_back(thread([&tt, t]() {
+      TranspositionTable::Entry e;
+      uint64_t state = 0x9E3779B97F4A7C15ull * (t + 1);
+      for (int i=0; i<200000; i++)
+      {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        uint64_t hash = (state >> 16) % 5000 * 0x9E3779B97F4A7C15ull;
+        int score = (int)(hash >> 52);
+        if (i % 2)
+          tt.store(hash, (int)(hash >> 60), TranspositionTable::EXACT, score, Board::Move());
+        else if (tt.probe(hash, e))
+          assert(e.score == score);
+      }
+    }));
+  }
+  for (size_t t=0; t<threads.size(); t++)
+    threads[t].join();
+}
+
+void searchPlaysLegalMoves()
+{
+  TranspositionTable tt(1);
+  Search search(tt);
+  Board board;
+
+  SearchResult result = search.run(board, SearchLimits::toDepth(5));
+  assert(result.hasMove);
+  assert(result.depth == 5);
+  assert(result.pv.size() >= 1 && result.pv[0] == result.bestMove);
+
+  // The whole principal variation is playable
+  for (size_t i=0; i<result.pv.size(); i++)
+  {
+    Board::Move m;
+    assert(board.findMove(Board::coordOf(result.pv[i].from()),
+      Board::coordOf(result.pv[i].to()), m));
+    board.makeMove(m);
+  }
+
+  // Node budgets are honoured
+  result = search.run(Board(), SearchLimits::forNodes(2000));
+  assert(result.hasMove);
+  assert(result.nodes <= 2000);
+
+  // Memory is what a search wrote, not what the table still holds
+  // from earlier ones: a shallow search after a deep one reports less
+  SearchResult deep = search.run(Board(), SearchLimits::toDepth(9));
+  SearchResult shallow = search.run(Board(), SearchLimits::toDepth(3));
+  assert(deep.memory > shallow.memory && deep.memory < tt.bytes());
+}
+
+void searchWinsByCapturingLastPiece()
+{
+  Board board;
+  board.clear();
+  board.setPlayerDirection(1, Board::Direction::A_TO_H);
+  board.setPlayerDirection(2, Board::Direction::H_TO_A);
+  board.set(Piece(1), Board::C1);
+  board.set(Piece(1), Board::A7);
+  board.set(Piece(2), Board::D2);
+
+  TranspositionTable tt(1);
+  Search search(tt);
+  SearchResult result = search.run(board, SearchLimits::toDepth(6));
+  assert(result.hasMove);
+  assert(result.bestMove == Board::Move(Board::squareOf(Board::C1),
+    Board::squareOf(Board::E3), Board::squareOf(Board::D2)));
+  assert(Search::isWinScore(result.score) && result.score > 0);
+
+  // A side with nothing to move has no move to offer
+  board.makeMove(result.bestMove);
+  result = search.run(board, SearchLimits::toDepth(3));
+  assert(!result.hasMove);
+}
+
+// Perft the slow way: the reference moves, each played with makeMove()
+// on a board copy
+uint64_t bruteForcePerft(const Board& board, int depth)
+{
+  if (depth == 0)
+    return 1;
+
+  Board scratch = board;
+  vector<Board::Move> moves = referenceMoves(scratch, scratch.sideToMove());
+  uint64_t nodes = 0;
+  for (size_t i=0; i<moves.size(); i++)
+  {
+    Board next = board;
+    assert(next.isLegal(moves[i]));
+    next.makeMove(moves[i]);
+    nodes += bruteForcePerft(next, depth - 1);
+  }
+  return nodes;
+}
+
+void storedPerftCountsMatchLegalMove()
+{
+  vector<Perft::Count> counts = Perft::load("perft.txt");
+  assert(counts.size() > 0);
+  for (size_t i=0; i<counts.size(); i++)
+  {
+    if (counts[i].depth > 3)
+      continue;
+    Board board;
+    board.setPosition(counts[i].position);
+    assert(board.position() == counts[i].position);
+    assert(bruteForcePerft(board, counts[i].depth) == counts[i].nodes);
+    assert(Perft::count(board, counts[i].depth) == counts[i].nodes);
+  }
+}
+
+int fibonacci(ThreadPool& pool, int n)
+{
+  if (n < 12)
+    return n < 2 ? n : fibonacci(pool, n - 1) + fibonacci(pool, n - 2);
+
+  // Tasks that split and wait on their own children
+  int a = 0, b = 0;
+  ThreadPool::TaskGroup group;
+  pool.submit(group, [&pool, &a, n]() { a = fibonacci(pool, n - 1); });
+  pool.submit(group, [&pool, &b, n]() { b = fibonacci(pool, n - 2); });
+  pool.wait(group);
+  return a + b;
+}
+
+void threadPoolRunsNestedTasks()
+{
+  ThreadPool pool(4);
+  assert(pool.size() == 4);
+  assert(fibonacci(pool, 20) == 6765);
+
+  atomic<int> ran(0);
+  ThreadPool::TaskGroup group;
+  for (int i=0; i<1000; i++)
+    pool.submit(group, [&ran]() { ran++; });
+  pool.wait(group);
+  assert(group.done() && ran == 1000);
+}
+
+void parallelPerftMatchesSerial()
+{
+  ThreadPool pool(3);
+  Board board;
+  assert(Perft::count(board, 6, pool) == Perft::count(board, 6));
+  board.setPosition("1:xO../.xox/.x.o/x.oo/x.../o.o./.o.o/X.o.");
+  assert(Perft::count(board, 5, pool, 3) == Perft::count(board, 5));
+}
+
+void lazySmpSearchPlaysLegalMoves()
+{
+  TranspositionTable tt(4);
+  ThreadPool pool(3);
+  Search search(tt);
+  search.setPool(&pool);
+
+  SearchLimits limits = SearchLimits::toDepth(8);
+  limits.threads = 4;
+  Board board;
+  SearchResult result = search.run(board, limits);
+  assert(result.hasMove && result.depth == 8);
+  Board::Move m;
+  assert(board.findMove(Board::coordOf(result.bestMove.from()),
+    Board::coordOf(result.bestMove.to()), m));
+
+  limits = SearchLimits::forTime(50);
+  limits.threads = 4;
+  result = search.run(board, limits);
+  assert(result.hasMove);
+}
+
+void searchesCanBeCancelledAndPondered()
+{
+  TranspositionTable tt(4);
+  Search search(tt);
+  Board board;
+
+  // A stop signal set before the search starts still stops it
+  atomic<bool> cancelled(true);
+  search.setStopSignal(&cancelled);
+  SearchResult result = search.run(board, SearchLimits());
+  assert(result.hasMove && result.depth == 0);
+  search.setStopSignal(nullptr);
+
+  Board::MoveList moves;
+  board.generateMoves(board.sideToMove(), moves);
+  assert(moves.size() > 1);
+  Ponder ponder(search);
+
+  // A miss is abandoned at once, however long the budget
+  auto start = chrono::steady_clock::now();
+  PositionHistory game;
+  ponder.start(board, game, moves[0]);
+  assert(ponder.active() && ponder.predicted() == moves[0]);
+  assert(!ponder.finish(moves[1], 60000, result));
+  assert(!ponder.active());
+  assert(chrono::steady_clock::now() - start < chrono::seconds(5));
+
+  // A hit answers the predicted position once the budget is spent
+  ponder.start(board, game, moves[0]);
+  this_thread::sleep_for(chrono::milliseconds(20));
+  assert(ponder.finish(moves[0], 100, result));
+  assert(!ponder.active() && result.depth >= 1);
+  Board next = board;
+  next.makeMove(moves[0]);
+  assert(next.isLegal(result.bestMove));
+
+  // Cancelling, or another start, ends a ponder that isn't finished
+  ponder.start(next, game, result.bestMove);
+  ponder.start(board, game, moves[1]);
+  ponder.cancel();
+  assert(!ponder.active());
+  assert(!ponder.finish(moves[1], 100, result));
+}
+
+void arenasAndNodePoolsHandOutMemory()
+{
+  Arena arena(1024);
+  char* c = arena.allocate<char>(3);
+  uint64_t* u = arena.allocate<uint64_t>(10);
+  assert(c != nullptr && ((uintptr_t)u & 7) == 0 && (char*)u >= c + 3);
+  assert(arena.bytesUsed() == 83 && arena.bytesReserved() == 1024);
+
+  // A rewind or reset hands back the same memory
+  Arena::Mark mark = arena.mark();
+  uint32_t* first = arena.allocate<uint32_t>(4);
+  arena.rewind(mark);
+  assert(arena.allocate<uint32_t>(4) == first && arena.bytesUsed() == 99);
+  arena.reset();
+  assert(arena.allocate<char>(3) == c && arena.bytesUsed() == 3);
+
+  // Too big for a block gets a block of its own; the rest go on after it
+  char* big = arena.allocate<char>(5000);
+  big[4999] = 1;
+  assert(arena.bytesReserved() >= 1024 + 5000 && arena.peakBytes() == 5003);
+  arena.reset();
+  assert(arena.allocate<char>(3) == c && arena.bytesUsed() == 3);
+
+  // Threads allocating at once get runs that don't overlap
+  NodePool<uint32_t> pool(1);
+  assert(pool.capacity() == (1 << 20) / 4 && pool.size() == 0);
+  vector<thread> threads;
+  for (int t=0; t<4; t++)
+  {
+    threads.push_back(thread([&pool, t]() {
+      for (int i=0; i<1000; i++)
+      {
+        uint32_t first = pool.allocate(8);
+        for (uint32_t k=0; k<8; k++)
+          pool[first + k] = (uint32_t)(t * 1000 + i);
+      }
+    }));
+  }
+  for (size_t t=0; t<threads.size(); t++)
+    threads[t].join();
+  assert(pool.size() == 32000 && pool.bytesUsed() == 128000);
+  for (uint32_t i=0; i<pool.size(); i+=8)
+    for (uint32_t k=1; k<8; k++)
+      assert(pool[i + k] == pool[i]);
+
+  // A full pool says so, and reset() keeps a prefix
+  assert(pool.allocate(pool.capacity()) == NodePool<uint32_t>::NONE);
+  assert(pool.allocate(pool.capacity() - 32000) == NodePool<uint32_t>::NONE);
+  pool.reset(8);
+  assert(pool.size() == 8 && pool.allocate(8) == 8);
+}
+
+void monteCarloPlaysLegalMovesAndKeepsItsTree()
+{
+  Board board;
+  MonteCarlo mc(4);
+  SearchResult result = mc.run(board, SearchLimits::forNodes(3000));
+  assert(result.hasMove && result.nodes >= 3000 && result.depth >= 1);
+  assert(board.isLegal(result.bestMove) && result.pv[0] == result.bestMove);
+  assert(mc.reusedNodes() <= 1 && mc.treeNodes() > 1000);
+  assert(result.memory >= mc.treeNodes() * 16);
+
+  // Our move and a reply are in the tree, so their subtree is kept
+  board.makeMove(result.bestMove);
+  Board::MoveList replies;
+  board.generateMoves(board.sideToMove(), replies);
+  board.makeMove(result.pv.size() > 1 ? result.pv[1] : replies[0]);
+  result = mc.run(board, SearchLimits::forNodes(1000));
+  assert(mc.reusedNodes() > 1 && board.isLegal(result.bestMove));
+
+  // A position from elsewhere starts a new tree
+  Board other;
+  other.setPosition("1:x.../..../..../..../..../..../..../o...");
+  result = mc.run(other, SearchLimits::forNodes(200));
+  assert(mc.reusedNodes() <= 1 && other.isLegal(result.bestMove));
+
+  // A forced capture is played without a search
+  board.clear();
+  board.setPlayerDirection(1, Board::Direction::A_TO_H);
+  board.setPlayerDirection(2, Board::Direction::H_TO_A);
+  board.set(Piece(1), Board::C1);
+  board.set(Piece(1), Board::A7);
+  board.set(Piece(2), Board::D2);
+  result = mc.run(board, SearchLimits::forNodes(500));
+  assert(result.bestMove == Board::Move(Board::squareOf(Board::C1),
+    Board::squareOf(Board::E3), Board::squareOf(Board::D2)));
+  assert(result.nodes == 0);
+
+  // Threads share the tree, and a full arena only stops it growing
+  ThreadPool pool(3);
+  MonteCarlo small(1);
+  small.setPool(&pool);
+  SearchLimits limits = SearchLimits::forNodes(60000);
+  limits.threads = 4;
+  board = Board();
+  result = small.run(board, limits);
+  assert(result.hasMove && board.isLegal(result.bestMove) && result.nodes >= 60000);
+  assert(small.treeNodes() <= small.capacity());
+}
+
+void pawnsCannotJumpEmptySquares()
+{
+  Board board;
+  board.clear();
+  board.set(Piece(1), Board::C1);
+  assert(board.legalMove(Board::C1, Board::E3) == false);
+
+  Board::MoveList list;
+  board.generateMoves(1, list);
+  assert(list.size() == 2);
+  assert(!list[0].isJump() && !list[1].isJump());
+
+  // Put something to jump in the way and the jump appears, and since
+  // capturing is compulsory it is the only move
+  board.set(Piece(2), Board::D8);
+  board.generateMoves(1, list);
+  assert(list.size() == 1);
+  assert(list[0].isJump());
+  assert(board.legalMove(Board::C1, Board::D2) == false);
+  assert(list[0].from() == Board::squareOf(Board::C1));
+  assert(list[0].to() == Board::squareOf(Board::E7));
+  assert(list[0].jumped() == Board::squareOf(Board::D8));
+}
+
+void gameArchivesRoundTrip()
+{
+  // A game with a jump, and one from a set position with scores
+  GameRecord first;
+  Board board;
+  const Board::Coord line[][2] = {
+    { Board::C3, Board::D4 }, { Board::F6, Board::E5 }, { Board::D4, Board::F6 }
+  };
+  for (int i=0; i<3; i++)
+  {
+    Board::Move m;
+    assert(board.findMove(line[i][0], line[i][1], m));
+    first.moves.push_back(m);
+    board.makeMove(m);
+  }
+  assert(first.moves[2].isJump());
+
+  GameRecord second;
+  Board start;
+  start.setPosition("2:..../..../.x.x/..../..../..../..../..O.");
+  second.setStart(start);
+  second.result = GameRecord::PLAYER1;
+  Board::MoveList list;
+  start.generateMoves(start.sideToMove(), list);
+  second.moves.push_back(list[0]);
+  second.scores.push_back(-42);
+
+  string filename = "/tmp/cctest.ccgr";
+  for (int indexed=0; indexed<2; indexed++)
+  {
+    {
+      GameWriter writer(filename, indexed == 1);
+      for (int i=0; i<1000; i++)
+        writer.add(i % 2 == 0 ? first : second);
+      writer.close();
+      assert(writer.games() == 1000);
+    }
+
+    GameArchive archive(filename);
+    assert(archive.size() == 1000);
+    GameRecord r;
+    archive.game(998).read(r);
+    assert(!r.hasStart && r.result == GameRecord::UNKNOWN && r.moves == first.moves && r.scores.empty());
+    GameArchive::Game g = archive.game(999);
+    assert(g.hasStart() && g.plies() == 1 && g.move(0) == list[0] && g.score(0) == -42);
+    assert(g.result() == GameRecord::PLAYER1);
+    assert(g.startBoard().position() == start.position());
+  }
+  remove(filename.c_str());
+
+  // A multi-jump keeps what it captured
+  GameRecord chained;
+  Board seam;
+  seam.setPosition("1:..../..../..../..../..../..../..../....");
+  seam.set(Piece(1, 0), Board::B2);
+  seam.set(Piece(2, 0), Board::C1);
+  seam.set(Piece(2, 0), Board::E7);
+  chained.setStart(seam);
+  seam.generateMoves(1, list);
+  assert(list.size() == 1 && list[0].jumps() == 2);
+  chained.moves.push_back(list[0]);
+  {
+    GameWriter writer(filename, false);
+    writer.add(first);
+    writer.add(chained);
+    writer.close();
+  }
+  {
+    GameArchive archive(filename);
+    assert(!archive.game(0).hasCaptures() && archive.game(0).move(2) == first.moves[2]);
+    GameArchive::Game g = archive.game(1);
+    assert(g.hasCaptures() && g.move(0) == list[0]);
+    GameRecord r;
+    g.read(r);
+    assert(r.moves == chained.moves);
+  }
+  remove(filename.c_str());
+
+  // A corrupted index or square is refused, and a count too big for the
+  // index is ignored in favour of walking the games
+  for (int damage=0; damage<3; damage++)
+  {
+    {
+      GameWriter writer(filename);
+      writer.add(first);
+      writer.add(first);
+      writer.close();
+    }
+    FILE* f = fopen(filename.c_str(), "r+b");
+    uint64_t indexOffset;
+    fseek(f, 16, SEEK_SET);
+    assert(fread(&indexOffset, 8, 1, f) == 1);
+    uint64_t huge = 1ull << 61;
+    uint8_t square = 200;
+    if (damage == 0)
+      fseek(f, (long)indexOffset + 8, SEEK_SET); // the second game's offset
+    else if (damage == 1)
+      fseek(f, 8, SEEK_SET); // the count
+    else
+      fseek(f, 24 + 4, SEEK_SET); // the first game's first square
+    if (damage < 2)
+      fwrite(&huge, 8, 1, f);
+    else
+      fwrite(&square, 1, 1, f);
+    fclose(f);
+
+    bool threw = false;
+    try
+    {
+      GameArchive archive(filename);
+      assert(archive.size() == 2);
+    }
+    catch (const char*) { threw = true; }
+    assert(threw == (damage != 1));
+  }
+  remove(filename.c_str());
+
+  // Traces import as the moves that stood after every undo
+  istringstream trace(
+    "board.move(Board::C3,Board::D4);\n"
+    "board.move(Board::F6,Board::E5);\n"
+    "board.move(Board::F2,Board::E3);\n"
+    "// undo\n"
+    "board.move(Board::D4,Board::F6);\n");
+  GameRecord imported;
+  GameArchive::readTrace(trace, imported);
+  assert(imported.moves == first.moves);
+}
+
+void replayFlagsIllegalMovesAndWrongResults()
+{
+  // A won game, then one with an illegal move, then one whose
+  // recorded winner is wrong, then one that starts out of turn
+  GameRecord won;
+  Board start;
+  start.setPosition("1:..../..../..../..x./..o./..../..../....");
+  won.setStart(start);
+  Board board = start;
+  Board::MoveList list;
+  board.generateMoves(1, list);
+  assert(list[0].isJump());
+  won.moves.push_back(list[0]);
+  won.result = GameRecord::PLAYER1;
+
+  GameRecord illegal;
+  illegal.moves.push_back(Board::Move(Board::squareOf(Board::C1), Board::squareOf(Board::D2)));
+  illegal.moves.push_back(Board::Move(Board::squareOf(Board::D2), Board::squareOf(Board::C1)));
+  GameRecord wrong = won;
+  wrong.result = GameRecord::PLAYER2;
+  GameRecord outOfTurn;
+  outOfTurn.moves.push_back(Board::Move(Board::squareOf(Board::F6), Board::squareOf(Board::E5)));
+
+  string filename = "/tmp/cctest-replay.ccgr";
+  {
+    GameWriter writer(filename);
+    writer.add(won);
+    writer.add(illegal);
+    writer.add(wrong);
+    writer.add(outOfTurn);
+    writer.close();
+  }
+  GameArchive archive(filename);
+  ThreadPool pool(2);
+  Replay::Report r = Replay::run(archive, pool);
+  assert(r.games == 4 && r.moves == 3);
+  assert(r.outcomes[GameRecord::PLAYER1] == 2);
+  assert(r.illegal.size() == 2 && r.illegal[0].game == 1 && r.illegal[0].ply == 1);
+  assert(r.illegal[1].game == 3 && r.illegal[1].ply == 0);
+  assert(r.mismatched.size() == 1 && r.mismatched[0].game == 2);
+  assert(r.mismatched[0].replayed == GameRecord::PLAYER1);
+  remove(filename.c_str());
+}
+
+void selfPlayStreamsLegalGames()
+{
+  SelfPlay::Settings settings;
+  settings.games = 6;
+  settings.threads = 2;
+  settings.limits = SearchLimits::toDepth(2);
+  settings.randomPlies = 4;
+  settings.maxPlies = 60;
+  settings.hashMegabytes = 1;
+  settings.batchGames = 4;
+
+  ThreadPool pool(2);
+  ostringstream out;
+  SelfPlay::Summary summary = SelfPlay::run(settings, pool, out, nullptr);
+  assert(summary.games == 6);
+  assert(summary.results[0] + summary.results[1] + summary.results[2] == 6);
+
+  // Every game is a line whose moves replay legally to its result
+  istringstream in(out.str());
+  string line;
+  vector<bool> seen(6, false);
+  while (getline(in, line))
+  {
+    istringstream fields(line);
+    string word, result, moves;
+    int number, plies;
+    fields >> word >> number >> word >> result >> word >> plies;
+    assert(number >= 0 && number < 6 && !seen[number]);
+    seen[number] = true;
+    while (fields >> word && word != "moves") { }
+
+    Board board;
+    int played = 0;
+    while (fields >> word)
+    {
+      Board::Move m;
+      Board::Coord from(word.substr(0, 1), atoi(word.substr(1, 1).c_str()));
+      Board::Coord to(word.substr(3, 1), atoi(word.substr(4, 1).c_str()));
+      assert(board.findMove(from, to, m));
+      board.makeMove(m);
+      assert((word.find(':') != string::npos) == (played >= 4));
+      played++;
+    }
+    assert(played == plies);
+    Board::MoveList list;
+    board.generateMoves(board.sideToMove(), list);
+    if (result == "1/2-1/2")
+      assert(plies == 60);
+    else
+      assert(list.empty() && result == (board.sideToMove() == 2 ? "1-0" : "0-1"));
+  }
+  for (int i=0; i<6; i++)
+    assert(seen[i]);
+
+  // A game depends only on the seed and its number
+  TranspositionTable tt(1);
+  Search search(tt);
+  SelfPlay::Game one, two;
+  Board board;
+  SelfPlay::play(board, search, settings, 3, one);
+  board = Board();
+  tt.clear();
+  SelfPlay::play(board, search, settings, 3, two);
+  assert(one.moves == two.moves);
+
+  // A writer's error comes back out of run() rather than out of the pool
+  string filename = "/tmp/cctest-selfplay.ccgr";
+  GameWriter closed(filename);
+  closed.close();
+  bool threw = false;
+  try { SelfPlay::run(settings, pool, closed, nullptr); } catch (const char*) { threw = true; }
+  assert(threw);
+  remove(filename.c_str());
+}
+
+void protocolServesManySessions()
+{
+  ThreadPool pool(2);
+  ostringstream out;
+  Protocol protocol(out, pool, 1);
+
+  // Many games at once, each searched while the others are set up
+  const string openings[] = { "c1,d2", "c3,d4", "c5,d6", "c7,d8", "c3,d2", "c5,d4", "c7,d6", "c1,d8" };
+  string commands;
+  for (int g=0; g<20; g++)
+  {
+    string id = "g" + to_string(g);
+    commands += "position " + id + " start moves " + openings[g % 8] + "\n";
+    commands += "go " + id + " depth 3\n";
+  }
+  commands += "sessions\nisready\n";
+  istringstream in(commands);
+  string line;
+  while (getline(in, line))
+    assert(protocol.handle(line));
+
+  // One ok and one bestmove per game, whose move is legal there
+  istringstream replies(out.str());
+  int oks = 0, bestmoves = 0;
+  bool ready = false;
+  while (getline(replies, line))
+  {
+    istringstream fields(line);
+    string kind, id, move;
+    fields >> kind >> id >> move;
+    if (kind == "ok")
+      oks++;
+    else if (kind == "bestmove")
+    {
+      bestmoves++;
+      out.str("");
+      protocol.handle("legal " + id);
+      assert(out.str().find(" " + move) != string::npos);
+    }
+    else if (kind == "sessions")
+      assert(id == "20");
+    else
+      ready = (kind == "readyok");
+  }
+  assert(oks == 20 && bestmoves == 20 && ready);
+
+  // Moves play and come back; a bad one changes nothing
+  out.str("");
+  protocol.handle("position p start");
+  protocol.handle("moves p c1,d2 f2,e3 c3,d4");
+  protocol.handle("board p");
+  Board played;
+  assert(played.move(Board::C1, Board::D2) && played.move(Board::F2, Board::E3) &&
+    played.move(Board::C3, Board::D4));
+  assert(out.str() == "ok p\nok p\nboard p " + played.position() + " result * plies 3\n");
+  out.str("");
+  protocol.handle("moves p f6,e5 a1,b2");
+  protocol.handle("undo p 3");
+  protocol.handle("board p");
+  protocol.handle("go nobody");
+  protocol.handle("checkmate p");
+  assert(out.str() == "error p Illegal move\nok p\nboard p " + Board().position() +
+    " result * plies 0\nerror nobody Unknown session\nerror Unrecognized command\n");
+
+  // Chains that share their end squares need their captures named
+  out.str("");
+  protocol.handle("position chain 1:..../.x../.oo./..../.oo./..../..../...o");
+  protocol.handle("moves chain b4,f4");
+  protocol.handle("moves chain b4,f4xc5e5");
+  protocol.handle("board chain");
+  Board chain;
+  chain.setPosition("1:..../.x../.oo./..../.oo./..../..../...o");
+  Board::Move m = Protocol::parseMove(chain, "b4,f4xc5e5");
+  assert(m.jumps() == 2 && Protocol::moveText(m) == "b4,f4xc5e5");
+  chain.makeMove(m);
+  assert(out.str() == "ok chain\nerror chain Ambiguous move: name its captures\nok chain\n"
+    "board chain " + chain.position() + " result * plies 1\n");
+
+  // A session that is searching takes nothing but stop until it answers
+  out.str("");
+  protocol.handle("go p depth 40");
+  protocol.handle("moves p c1,d2");
+  protocol.handle("position p start");
+  protocol.handle("close p");
+  protocol.handle("stop p");
+  protocol.handle("isready");
+  protocol.handle("board p");
+  string text = out.str();
+  assert(text.find("error p Searching\nerror p Searching\nerror p Searching\n") == 0);
+  size_t bestmove = text.find("bestmove p ");
+  assert(bestmove != string::npos && bestmove < text.find("readyok\n"));
+  assert(text.find("board p " + Board().position() + " result * plies 0\n") != string::npos);
+
+  // A stop right behind its go is kept, however soon it comes
+  out.str("");
+  for (int i=0; i<50; i++)
+  {
+    protocol.handle("go p depth 40");
+    protocol.handle("stop p");
+    protocol.handle("isready");
+  }
+  text = out.str();
+  int answered = 0;
+  for (size_t at=text.find("bestmove p "); at!=string::npos; at=text.find("bestmove p ", at + 1))
+    answered++;
+  assert(answered == 50);
+
+  // A command the session takes again comes after its bestmove
+  for (int i=0; i<20; i++)
+  {
+    out.str("");
+    protocol.handle("go p depth 2");
+    for (int j=0; j<200; j++)
+      protocol.handle("legal p");
+    protocol.handle("isready");
+    text = out.str();
+    size_t legal = text.find("legal p ");
+    assert(legal == string::npos || legal > text.find("bestmove p "));
+  }
+  assert(!protocol.handle("quit"));
+}
+
+void serverPlaysGamesOverSockets()
+{
+  ThreadPool pool(2);
+  Server server(pool, 1);
+  server.listenUnix("/tmp/cctest.sock");
+  server.listenTcp(0);
+  thread loop([&]() { server.run(); });
+
+  {
+    // One game, played from both kinds of socket
+    ServerClient local("/tmp/cctest.sock");
+    ServerClient tcp(server.tcpPort());
+    local.send("position g start moves c1,d2");
+    assert(local.receive() == "ok g");
+    tcp.send("moves g f2,e3");
+    assert(tcp.receive() == "ok g");
+    local.send("board g");
+    Board board;
+    assert(board.move(Board::C1, Board::D2) && board.move(Board::F2, Board::E3));
+    assert(local.receive() == "board g " + board.position() + " result * plies 2");
+
+    // A searching game takes nothing else until its answer is sent
+    tcp.send("go g depth 4\nmoves g c3,d4");
+    assert(tcp.receive() == "error g Searching");
+    istringstream best(tcp.receive());
+    string word, id, move;
+    best >> word >> id >> move;
+    assert(word == "bestmove" && id == "g");
+    tcp.send("moves g " + move);
+    assert(tcp.receive() == "ok g");
+
+    local.send("bogus\nlegal nobody\nstats");
+    assert(local.receive() == "error Unrecognized command");
+    assert(local.receive() == "error nobody Unknown session");
+    assert(local.receive() == "stats connections 2 games 1 moves 3 searches 1");
+    local.send("quit");
+
+    // A client that stops sending still hears every reply, then the close
+    ServerClient last(server.tcpPort());
+    last.send("position h start\nboard h\nsessions\ngo h depth 6");
+    last.finish();
+    assert(last.receive() == "ok h");
+    assert(last.receive() == "board h " + Board().position() + " result * plies 0");
+    assert(last.receive() == "sessions 2");
+    assert(last.receive().find("bestmove h ") == 0);
+    bool closed = false;
+    try { last.receive(); } catch (const char*) { closed = true; }
+    assert(closed);
+  }
+
+  server.stop();
+  loop.join();
+}
+
+void symmetricPositionsAreTheSameGame()
+{
+  Board board;
+  board.setPosition("1:xO../.xox/.x.o/x.oo/x.../o.o./.o.o/X.o.");
+  Board::MoveList moves;
+  board.generateMoves(board.sideToMove(), moves);
+  uint64_t nodes = Perft::count(board, 4);
+
+  Board first = board;
+  first.canonicalize();
+  for (int t=0; t<Board::SYMMETRIES; t++)
+  {
+    Board image = board;
+    image.transform(t);
+    assert(image.hash() == board.hash() && image.hash() == image.computeHash());
+    assert(Perft::count(image, 4) == nodes);
+
+    // Every image has the same representative, and symmetry() finds it
+    int s = image.symmetry();
+    Board canonical = image;
+    assert(canonical.canonicalize() == s);
+    assert(canonical.position() == first.position());
+
+    // Moves carry over between images
+    Board::MoveList imageMoves;
+    image.generateMoves(image.sideToMove(), imageMoves);
+    assert(imageMoves.size() == moves.size());
+    for (int i=0; i<moves.size(); i++)
+    {
+      Board::Move m = Board::transformMove(t, moves[i]);
+      Board::Move back;
+      assert(image.findMove(Board::coordOf(m.from()), Board::coordOf(m.to()), back) && back == m);
+      assert(Board::transformMove(Board::inverseSymmetry(t), m) == moves[i]);
+    }
+  }
+
+  // c3 moves to c5, then mirrors to c7
+  int c3 = Board::squareOf(Board::C3);
+  assert(Board::transformSquare(1, c3) == Board::squareOf(Board::C5));
+  assert(Board::transformSquare(4, c3) == Board::squareOf(Board::C7));
+  assert(Board::transformSquare(5, c3) == Board::squareOf(Board::C1));
+}
+
+void tablebaseIndexRoundTrips()
+{
+  Tablebase::Signature sig = { { 1, 1, 1, 0 } };
+  uint64_t count = 2 * sig.positions();
+  assert(count == 2 * 32 * 31 * 30);
+  for (uint64_t i=0; i<count; i+=7)
+  {
+    Board board;
+    Tablebase::setup(board, sig, i);
+    assert(board.hash() == board.computeHash());
+    assert(Tablebase::Signature::of(board).key() == sig.key());
+    assert(Tablebase::index(board, sig) == i);
+  }
+}
+
+void tablebaseIsConsistentWithItsMoves()
+{
+  char directory[] = "/tmp/cctbXXXXXX";
+  assert(mkdtemp(directory) != nullptr);
+  Tablebase::generate(directory, 3, nullptr);
+  Tablebase tb(directory);
+  assert(tb.maxPieces() == 3);
+
+  // Every result follows from the results of the moves out of it
+  Tablebase::Signature sig = { { 2, 0, 0, 1 } };
+  for (uint64_t i=0; i<2 * sig.positions(); i+=3)
+  {
+    Board board;
+    Tablebase::setup(board, sig, i);
+    Tablebase::Result r;
+    assert(tb.probe(board, r));
+
+    Board::MoveList list;
+    board.generateMoves(board.sideToMove(), list);
+    int fastestLoss = 1000, slowestWin = -1;
+    bool draw = false;
+    for (int m=0; m<list.size(); m++)
+    {
+      Board::Undo undo = board.makeMove(list[m]);
+      Tablebase::Result child;
+      assert(tb.probe(board, child));
+      board.unmakeMove(list[m], undo);
+      if (child.outcome == Tablebase::LOSS)
+        fastestLoss = min(fastestLoss, child.plies);
+      else if (child.outcome == Tablebase::WIN)
+        slowestWin = max(slowestWin, child.plies);
+      else
+        draw = true;
+    }
+    if (r.outcome == Tablebase::WIN)
+      assert(r.plies == fastestLoss + 1);
+    else if (r.outcome == Tablebase::LOSS)
+      assert(fastestLoss == 1000 && !draw && r.plies == slowestWin + 1);
+    else
+      assert(fastestLoss == 1000 && draw);
+  }
+
+  // The search takes tablebase wins below the root
+  Board board;
+  board.setPosition("1:..../..../.x.x/..../..../..../..../..O.");
+  Tablebase::Result r;
+  assert(tb.probe(board, r));
+  TranspositionTable tt(1);
+  Search search(tt);
+  search.setTablebase(&tb);
+  SearchResult result = search.run(board, SearchLimits::toDepth(2));
+  assert(result.hasMove);
+  if (r.outcome == Tablebase::WIN)
+    assert(result.score == Search::WIN - r.plies);
+  else if (r.outcome == Tablebase::LOSS)
+    assert(result.score == -Search::WIN + r.plies);
+  else
+    assert(result.score == 0);
+
+  // A block word that counts past the stored values is refused, not read
+  Board first;
+  Tablebase::setup(first, sig, 0);
+  first.canonicalize();
+  assert(Tablebase::index(first, sig) < 512 && tb.probe(first, r));
+  string path = string(directory) + "/" + sig.name() + ".cctb";
+  FILE* file = fopen(path.c_str(), "r+b");
+  assert(file != nullptr);
+  uint64_t huge = 1ull << 40;
+  assert(fseek(file, 32, SEEK_SET) == 0 && fwrite(&huge, 8, 1, file) == 1);
+  fclose(file);
+  Tablebase corrupt(directory);
+  assert(!corrupt.probe(first, r));
 
+  string command = string("rm -rf ") + directory;
+  assert(system(command.c_str()) == 0);
 }
 
 int main(int argc, char* argv[])
@@ -226,10 +1794,12 @@ int main(int argc, char* argv[])
   cout << "Testing..." << endl;
   cout << "."; pieceCanBeDumped();
   cout << "."; coordDiagonalsAreCorrect();
+  cout << "."; neighbourTablesMatchCoordDiagonals();
   cout << "."; boardHoldsEmptyPieces();
   cout << "."; boardCanBeCleared();
   cout << "."; boardCanNormalizeColumns();
   cout << "."; boardIsSetUpForTwoPlayers();
+  cout << "."; boardIsPackedIntoDarkSquares();
   cout << "."; doNotAllowMovingNonpieces();
   cout << "."; doNotAllowNonsensicalMoves();
   cout << "."; piecesPromoteOnLastRow();
@@ -239,6 +1809,36 @@ int main(int argc, char* argv[])
   cout << "."; edgesKingMovement();
   cout << "."; pawnsCanJump();
   cout << "."; kingsCanJump();
+  cout << "."; generatorMatchesLegalMove();
+  cout << "."; customDirectionsAreHonoured();
+  cout << "."; pawnsCannotJumpEmptySquares();
+  cout << "."; movesAreEncodedCompactly();
+  cout << "."; unmakeMoveRestoresBoard();
+  cout << "."; makeMoveCapturesAndPromotes();
+  cout << "."; hashIsMaintainedIncrementally();
+  cout << "."; evaluationFeaturesAreCounted();
+  cout << "."; batchEvaluationMatchesBoards();
+  cout << "."; terminalStatesAreDetected();
+  cout << "."; transposedPositionsHashEqually();
+  cout << "."; transpositionTableStoresAndProbes();
+  cout << "."; transpositionTableIsSafeAcrossThreads();
+  cout << "."; searchPlaysLegalMoves();
+  cout << "."; searchWinsByCapturingLastPiece();
+  cout << "."; storedPerftCountsMatchLegalMove();
+  cout << "."; threadPoolRunsNestedTasks();
+  cout << "."; parallelPerftMatchesSerial();
+  cout << "."; lazySmpSearchPlaysLegalMoves();
+  cout << "."; searchesCanBeCancelledAndPondered();
+  cout << "."; arenasAndNodePoolsHandOutMemory();
+  cout << "."; monteCarloPlaysLegalMovesAndKeepsItsTree();
+  cout << "."; gameArchivesRoundTrip();
+  cout << "."; replayFlagsIllegalMovesAndWrongResults();
+  cout << "."; selfPlayStreamsLegalGames();
+  cout << "."; protocolServesManySessions();
+  cout << "."; serverPlaysGamesOverSockets();
+  cout << "."; symmetricPositionsAreTheSameGame();
+  cout << "."; tablebaseIndexRoundTrips();
+  cout << "."; tablebaseIsConsistentWithItsMoves();
   cout << endl << "End testing" << endl;
 
   return 0;